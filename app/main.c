@@ -7,26 +7,26 @@
 #define WIDTH 1024
 #define HEIGHT 640
 
-static GLuint vao;
-static GLuint vbo;
-static GLuint ebo;
-
-static float colors[] = {
-  1.f, 0.f, 0.f,
-  0.f, 1.f, 0.f,
-  0.f, 0.f, 1.f,
-  0.f, 1.f, 0.f,
+static kyu_gpu_mesh gpu_mesh;
+
+static const kyu_color colors[] = {
+  { 1.f, 0.f, 0.f, 1.f },
+  { 0.f, 1.f, 0.f, 1.f },
+  { 0.f, 0.f, 1.f, 1.f },
+  { 0.f, 1.f, 0.f, 1.f },
 };
 
 static kyu_matrix *matrix = NULL;
+static kyu_matrix *rotation = NULL;
 static GLuint program;
+static kyu_uniform_ring uniforms;
+static kyu_command_list commands;
 static kyu_mesh *mesh = NULL;
 
 static void
 init()
 {
   const char* mesh_file = "data/quad.obj";
-  size_t size, offset;
 
   clock_t before, after;
   double dur;
@@ -46,6 +46,7 @@ init()
   kyu_matrix_release(mat);
 
   matrix = kyu_matrix_identity4x4();
+  rotation = kyu_matrix_identity4x4();
 
   before = clock();
   mesh = kyu_mesh_read(mesh_file);
@@ -54,59 +55,36 @@ init()
   dur = 1000.0 * (after - before)/CLOCKS_PER_SEC;
   printf("\n-------------------------\nMesh '%s': %fms\n", mesh_file, dur);
   
-  /* VAO and VBO */
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
-
-  size = mesh->nb_vertices * sizeof(kyu_point) + sizeof(colors);
-  glGenBuffers(1, &vbo);
-  glGenBuffers(1, &ebo);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
-
-  offset = 0;
-  size = mesh->nb_vertices * sizeof(kyu_point);
-  glBufferSubData(GL_ARRAY_BUFFER, offset, size, mesh->vertices);
-  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)offset);
-  glEnableVertexAttribArray(0);
-
-  offset += size;
-  size = sizeof(colors);
-  glBufferSubData(GL_ARRAY_BUFFER, offset, size, colors);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)offset);
-  glEnableVertexAttribArray(1);
-
-  size = sizeof(unsigned int) * 3 * mesh->nb_triangles;
-  unsigned int *indices = malloc(size);
-  for (int i = 0; i < mesh->nb_triangles; ++i)
-    {
-      const kyu_triangle *tri = &mesh->triangles[i];
-      for (int j = 0; j < 3; ++j)
-        indices[i * 3 + j] = tri->vertices[j];
-    }
-  
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, indices, GL_STATIC_DRAW);
-  
-  free(indices);
+  /* One color per vertex, released with the mesh */
+  mesh->colors = kyu_malloc(mesh->nb_vertices * sizeof(kyu_color), KYU_MEMORY_MESH);
+  mesh->nb_colors = mesh->nb_vertices;
+  for (int i = 0; i < mesh->nb_vertices; ++i)
+    mesh->colors[i] = colors[i % 4];
 
-  glBindVertexArray(0);
+  kyu_gpu_mesh_init(&gpu_mesh, mesh);
+  printf("GPU mesh: %d vertices, %lu bytes\n", gpu_mesh.nb_vertices,
+         (unsigned long)gpu_mesh.bytes);
 
   /* glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); */
   
   /* Shaders */
+  kyu_set_shader_cache("shader_cache");
   program = read_shaders("shaders/base_vertex.glsl", "shaders/base_fragment.glsl");
+  kyu_uniform_block_binding(program, "draw", KYU_UNIFORM_DRAW);
+  kyu_uniform_ring_init(&uniforms, 64 * 1024);
+  kyu_command_list_init(&commands, 64);
 }
 
 static void
 quit()
 {
   kyu_matrix_release(matrix);
+  kyu_matrix_release(rotation);
   
-  glDeleteProgram(program);
-  glDeleteBuffers(1, &vbo);
-  glDeleteBuffers(1, &ebo);
-  glDeleteVertexArrays(1, &vao);
+  kyu_gl_delete_program(program);
+  kyu_uniform_ring_release(&uniforms);
+  kyu_command_list_release(&commands);
+  kyu_gpu_mesh_release(&gpu_mesh);
 
   kyu_mesh_release(mesh);
 }
@@ -117,32 +95,38 @@ static float angleZ = 0.f;
 static void
 update()
 {
-  kyu_matrix *m = kyu_matrix_rotateY(angleY);
+  kyu_matrix_set_rotateY(rotation, angleY);
   
   angleY += 1.f;
   angleZ += 0.5f;
 
-  kyu_matrix_release(matrix);
-  matrix = kyu_matrix_rotateZ(angleZ);
-  
-  kyu_matrix_mult(matrix, m, matrix);
-
-  kyu_matrix_release(m);
+  kyu_matrix_set_rotateZ(matrix, angleZ);
+  kyu_matrix_mult(matrix, rotation, matrix);
 }
 
 static void*
 render(void *v)
 {
+  kyu_draw_packet packet = { 0 };
+
   /* Render here */
   glClear(GL_COLOR_BUFFER_BIT);
 
-  glUseProgram(program);
+  /* Every block of the frame is written before the first draw */
+  packet.program = program;
+  packet.mesh = &gpu_mesh;
+  packet.material_block = -1;
+  packet.draw_block = -1;
+  packet.draw_size = 16 * sizeof(float);
 
-  GLint l = glGetUniformLocation(program, "mat");
-  glUniformMatrix4fv(l, 1, GL_TRUE, matrix->t);
-  
-  glBindVertexArray(vao);
-  glDrawElements(GL_TRIANGLES, mesh->nb_triangles * 3, GL_UNSIGNED_INT, 0);
+  if (kyu_uniform_ring_begin(&uniforms) == 0)
+    {
+      packet.draw_block = kyu_uniform_ring_push(&uniforms, matrix->t, packet.draw_size);
+      kyu_command_list_record(&commands, &packet);
+      kyu_uniform_ring_end(&uniforms);
+    }
+
+  kyu_command_list_submit(&commands, &uniforms);
 
   return v;
 }
@@ -5,10 +5,15 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #include "kyu/core/utils.h"
 #ifndef __KYU_PS2__
 #include "kyu/graphics/gl.h"
 #define KYU_FRAMERATE 60.0
+
+/* Updates run in a frame before the late ones are dropped */
+#define KYU_MAX_UPDATES 5
 #else
   #include <tamtypes.h>
   
@@ -25,11 +30,67 @@ extern "C" {
 
   typedef struct kyu_app kyu_app;
 
+  typedef enum {
+    KYU_VSYNC_OFF,
+    KYU_VSYNC_ON,
+    KYU_VSYNC_ADAPTIVE
+  } kyu_vsync;
+
   extern double kyu_deltatime;
 
   kyu_app *kyu_init(int width, int height, const char *name,
                     void (*init)(), void (*quit)(), void (*update)(), void *(*render)(void *v));
   int kyu_run(kyu_app *app);
+
+  /* Renders `frames` frames into an offscreen framebuffer, with EGL so
+     no display is needed (Mesa's llvmpipe works). Each frame runs exactly
+     one update, there is no swap, vsync nor frame limit and the window
+     framebuffer 0 can't be drawn to. Returns NULL when no context can be
+     created, or when kyu was built without EGL. */
+  kyu_app *kyu_init_headless(int width, int height, long frames,
+                             void (*init)(), void (*quit)(), void (*update)(),
+                             void *(*render)(void *v));
+
+  /* Reads the RGBA8 pixels of the app's framebuffer, width * height * 4
+     bytes with the sizes given at init and the bottom row first */
+  int kyu_read_pixels(kyu_app *app, unsigned char *pixels);
+
+  /* The framebuffer object frames are presented from: the offscreen one
+     when headless, 0 otherwise. Apps drawing to their own framebuffers
+     bind it back before the final pass. */
+  unsigned int kyu_default_framebuffer(const kyu_app *app);
+
+  /* After each update `publish` copies the state needed by the render
+     into a snapshot of `size` bytes. Before each render `interpolate`
+     blends the two latest snapshots, `alpha` being the fraction of an
+     update step elapsed since the latest one, and the result is given to
+     the render callback as its argument. Not available on the PS2. */
+  int kyu_set_snapshots(kyu_app *app, size_t size,
+                        void (*publish)(void *snapshot),
+                        void (*interpolate)(void *dest, const void *prev,
+                                            const void *next, double alpha));
+
+  /* Runs the fixed-timestep update on its own thread, which needs
+     snapshots: update() must not call OpenGL and render() must only read
+     the snapshot it receives. kyu_deltatime then belongs to the update
+     thread. */
+  int kyu_set_threaded_update(kyu_app *app, int enable);
+
+  /* Frame pacing, desktop only. The frame rate limit (0 for none) sleeps
+     then spins until the next frame is due; vsync is on by default. After
+     a stall at most `max_updates` updates run in one frame and the rest
+     of the backlog is dropped. */
+  int kyu_set_frame_rate(kyu_app *app, double fps);
+  int kyu_set_vsync(kyu_app *app, kyu_vsync vsync);
+  int kyu_set_max_updates(kyu_app *app, int max_updates);
+
+  /* kyu_run writes the frame-time percentiles of the session there
+     when it returns, see kyu/core/stats.h. NULL writes nothing. */
+  int kyu_set_stats_file(kyu_app *app, const char *filename);
+
+  /* Allocations made through kyu_malloc during the last frame, by every
+     thread of the library */
+  long kyu_get_frame_allocations(const kyu_app *app);
   
 #ifdef __cplusplus
 }
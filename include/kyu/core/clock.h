@@ -0,0 +1,38 @@
+/* clock -- monotonic time and precise waits
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_CLOCK_H
+#define KYU_CLOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /* Seconds since an arbitrary point, never goes backwards */
+  double kyu_clock_now(void);
+
+  void kyu_clock_sleep(double seconds);
+
+  /* Sleeps until shortly before `deadline` then spins for the rest. The
+     spin margin follows the oversleep measured on the calling thread. */
+  void kyu_clock_wait_until(double deadline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_CLOCK_H */
@@ -0,0 +1,68 @@
+/* frame -- per-tick linear allocator
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_FRAME_H
+#define KYU_FRAME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/* Initial size of each half of the update and render arenas */
+#define KYU_FRAME_ARENA_SIZE (256 * 1024)
+
+/* Allocations are 16-byte aligned */
+#define KYU_FRAME_ALIGN 16
+
+  /* Bump allocator with two halves: a reset switches to the other half,
+     so what was allocated during the previous tick stays valid. A tick
+     that does not fit spills to the heap and the half grows at its next
+     reset. */
+  typedef struct {
+    unsigned char *data[2];
+    size_t size[2];
+    size_t peak[2];
+    void *overflow[2];
+
+    size_t used;
+    int current;
+  } kyu_arena;
+
+  int   kyu_arena_init(kyu_arena *arena, size_t size);
+  void  kyu_arena_release(kyu_arena *arena);
+  void  kyu_arena_reset(kyu_arena *arena);
+  void *kyu_arena_alloc(kyu_arena *arena, size_t size);
+  int   kyu_arena_owns(kyu_arena *arena, const void *ptr);
+
+  /* kyu_run binds an arena to the update and the render loops and resets
+     it at each of their ticks. The frame functions use the arena bound to
+     the calling thread, they return NULL outside of those loops. */
+  void       kyu_frame_bind(kyu_arena *arena);
+  kyu_arena *kyu_frame_arena(void);
+  void      *kyu_frame_alloc(size_t size);
+  int        kyu_frame_owns(const void *ptr);
+
+#define KYU_FRAME_NEW(TYPE, COUNT) \
+  ((TYPE *)kyu_frame_alloc(sizeof(TYPE) * (size_t)(COUNT)))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_FRAME_H */
@@ -0,0 +1,66 @@
+/* job -- work-stealing job system
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_JOB_H
+#define KYU_JOB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Jobs in flight per thread, a power of 2. Jobs are allocated from a
+   ring so a thread may not have more unfinished jobs than this. */
+#define KYU_JOB_MAX 4096
+
+/* Threads that are not workers but may create jobs (kyu_job_attach) */
+#define KYU_JOB_ATTACHED 4
+
+/* One worker per hardware thread, the calling thread excluded */
+#define KYU_JOB_AUTO -1
+
+  typedef struct kyu_job kyu_job;
+
+  /* Starts the shared worker pool, kyu_init calls it with KYU_JOB_AUTO.
+     The calling thread takes part in the work while it waits on jobs.
+     The PS2 build has no workers: jobs run in kyu_job_wait. */
+  int  kyu_job_init(int nb_workers);
+  void kyu_job_quit(void);
+  int  kyu_job_workers(void);
+
+  /* Lets another thread (e.g. the update thread) create and wait on jobs */
+  int  kyu_job_attach(void);
+
+  /* A job with a parent only completes once its children are done.
+     Dependencies must be declared before either job is run. */
+  kyu_job *kyu_job_create(void (*func)(void *data), void *data,
+                          kyu_job *parent);
+  void kyu_job_depend(kyu_job *job, kyu_job *dependency);
+  void kyu_job_run(kyu_job *job);
+  void kyu_job_wait(kyu_job *job);
+  int  kyu_job_done(kyu_job *job);
+
+  /* Splits [0, count[ in ranges of at least `grain` items (0 picks one)
+     and returns when all of them are processed */
+  void kyu_job_parallel_for(int count, int grain,
+                            void (*func)(int begin, int end, void *data),
+                            void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_JOB_H */
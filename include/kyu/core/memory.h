@@ -0,0 +1,76 @@
+/* memory -- allocation hooks and per-subsystem statistics
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_MEMORY_H
+#define KYU_MEMORY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+
+  typedef enum {
+    KYU_MEMORY_CORE,
+    KYU_MEMORY_JOB,
+    KYU_MEMORY_FRAME,
+    KYU_MEMORY_PROFILE,
+    KYU_MEMORY_MATH,
+    KYU_MEMORY_MESH,
+    KYU_MEMORY_GRAPHICS,
+    KYU_MEMORY_TAGS
+  } kyu_memory_tag;
+
+  /* Every allocation of the library goes through these hooks, which must
+     return memory aligned on 16 bytes. The tag given to free is the one
+     of the allocation. */
+  typedef struct {
+    void *(*malloc)(size_t size, kyu_memory_tag tag, void *user);
+    void *(*realloc)(void *ptr, size_t size, kyu_memory_tag tag, void *user);
+    void  (*free)(void *ptr, kyu_memory_tag tag, void *user);
+    void *user;
+  } kyu_allocator;
+
+  typedef struct {
+    long live_bytes;
+    long peak_bytes;
+    long live_allocations;
+    long allocations;
+  } kyu_memory_stats;
+
+  /* Must be set before the first allocation, NULL restores the C library */
+  void kyu_set_allocator(const kyu_allocator *allocator);
+
+  void *kyu_malloc(size_t size, kyu_memory_tag tag);
+  void *kyu_calloc(size_t count, size_t size, kyu_memory_tag tag);
+  void *kyu_realloc(void *ptr, size_t size, kyu_memory_tag tag);
+  void  kyu_free(void *ptr);
+
+  /* Byte statistics only cover the allocations made while tracking is
+     on, the total allocation count is always kept */
+  void kyu_memory_tracking(int enable);
+  void kyu_memory_stats_get(kyu_memory_tag tag, kyu_memory_stats *stats);
+  long kyu_memory_allocations(void);
+  const char *kyu_memory_tag_name(kyu_memory_tag tag);
+  void kyu_memory_fprint(FILE *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_MEMORY_H */
@@ -0,0 +1,87 @@
+/* metrics -- live counters in shared memory
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_METRICS_H
+#define KYU_METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/core/memory.h"
+#include "kyu/core/stats.h"
+
+/* POSIX shared memory object, a named file mapping on Windows */
+#define KYU_METRICS_NAME "/kyu_metrics"
+
+#define KYU_METRICS_MAGIC 0x4b59554dL /* "KYUM" */
+#define KYU_METRICS_VERSION 2
+
+  /* Milliseconds over the rolling window of kyu/core/stats.h */
+  typedef struct {
+    double p50;
+    double p95;
+    double p99;
+    double max;
+  } kyu_metrics_times;
+
+  /* The block is rewritten after each frame. `sequence` is odd while it
+     is written: readers copy it and retry until the sequence was the
+     same even number before and after, kyu_metrics_sample does that. */
+  typedef struct {
+    long magic;
+    long version;
+    volatile long sequence;
+    long pid;
+
+    long frame;
+    double time;
+
+    kyu_metrics_times times[KYU_STATS];
+
+    /* Counted over the last frame */
+    long draw_calls;
+    long triangles;
+    long allocations;
+
+    /* Per subsystem, the last entry sums them all */
+    kyu_memory_stats memory[KYU_MEMORY_TAGS + 1];
+  } kyu_metrics_block;
+
+  /* Creates the block, memory tracking is turned on so that the byte
+     counts follow the allocations made from then on. Fails when a
+     running process already has a block of that name, one left behind
+     by a crashed process is replaced. */
+  int kyu_metrics_open(const char *name);
+  void kyu_metrics_close(void);
+
+  /* Draws made outside kyu should be reported too, from the render
+     thread */
+  void kyu_metrics_draw(long triangles);
+
+  /* Called by kyu_run after each frame, publishes and restarts the
+     per-frame counters */
+  void kyu_metrics_frame(long allocations);
+
+  /* From another process, or any thread */
+  int kyu_metrics_sample(const char *name, kyu_metrics_block *block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_METRICS_H */
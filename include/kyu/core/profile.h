@@ -0,0 +1,73 @@
+/* profile -- scoped-zone CPU profiler
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_PROFILE_H
+#define KYU_PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Events kept per thread, a power of 2. The oldest are overwritten. */
+#define KYU_PROFILE_EVENTS (1 << 14)
+
+/* Written when F12 is pressed in the kyu window */
+#define KYU_PROFILE_FILE "kyu_trace.json"
+
+  /* Zone names must outlive the dump, string literals are the intent.
+     Recording is on by default and costs a clock read and a store. */
+  void kyu_profile_begin(const char *name);
+  void kyu_profile_end(void);
+  void kyu_profile_thread_name(const char *name);
+  void kyu_profile_enable(int enable);
+
+  /* Chrome trace event JSON, loads in chrome://tracing and Perfetto */
+  int kyu_profile_dump(const char *filename);
+
+  const char *kyu_profile_scope_begin(const char *name);
+  void kyu_profile_scope_end(const char **name);
+
+#define KYU_PROFILE_CONCAT_(A, B) A##B
+#define KYU_PROFILE_CONCAT(A, B) KYU_PROFILE_CONCAT_(A, B)
+
+#ifndef KYU_NO_PROFILE
+#define KYU_PROFILE_BEGIN(NAME) kyu_profile_begin(NAME)
+#define KYU_PROFILE_END() kyu_profile_end()
+
+  /* Zone ending with the enclosing block, it needs the cleanup attribute.
+     Other compilers, MSVC included, don't get the macro at all rather
+     than zones silently missing: code built there must use
+     KYU_PROFILE_BEGIN/END. */
+#if defined(__GNUC__) || defined(__clang__)
+#define KYU_PROFILE_SCOPE(NAME)                                          \
+  const char *KYU_PROFILE_CONCAT(kyu_profile_zone_, __LINE__)            \
+  __attribute__((cleanup(kyu_profile_scope_end), unused))                \
+    = kyu_profile_scope_begin(NAME)
+#endif
+#else
+#define KYU_PROFILE_BEGIN(NAME) ((void)0)
+#define KYU_PROFILE_END() ((void)0)
+#if defined(__GNUC__) || defined(__clang__)
+#define KYU_PROFILE_SCOPE(NAME)
+#endif
+#endif /* !KYU_NO_PROFILE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_PROFILE_H */
@@ -0,0 +1,70 @@
+/* stats -- frame-time histograms and percentiles
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_STATS_H
+#define KYU_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Samples in the rolling window of each series, about 20 s at 50 fps */
+#define KYU_STATS_WINDOW 1024
+
+/* Log-scale buckets of 5% from 10 us, the last one takes anything above
+   2.5 s. Percentiles are the upper bound of their bucket. */
+#define KYU_STATS_BUCKETS 256
+#define KYU_STATS_MIN 1e-5
+#define KYU_STATS_GROWTH 1.05
+
+  typedef enum {
+    KYU_STAT_FRAME,
+    KYU_STAT_UPDATE,
+    KYU_STAT_RENDER,
+    KYU_STAT_WAIT,
+    KYU_STAT_SWAP,
+    KYU_STAT_GPU, /* kyu/graphics/timer.h, a few frames late */
+    KYU_STATS
+  } kyu_stat;
+
+  /* In seconds */
+  typedef struct {
+    long samples;
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+  } kyu_stats_summary;
+
+  /* kyu_run records every series, the calls are thread safe */
+  void kyu_stats_record(kyu_stat stat, double seconds);
+  void kyu_stats_reset(void);
+
+  /* Over the rolling window, or since the start of the session */
+  int kyu_stats_get(kyu_stat stat, kyu_stats_summary *summary);
+  int kyu_stats_get_session(kyu_stat stat, kyu_stats_summary *summary);
+  const char *kyu_stats_name(kyu_stat stat);
+
+  /* One line per series with the session numbers in milliseconds */
+  int kyu_stats_dump(const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_STATS_H */
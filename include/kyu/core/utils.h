@@ -56,7 +56,7 @@ extern "C" {
 #define MIN(A, B) ((A) < (B) ? (A) : (B))
 
 #define RAD(X) ((X) * M_PI / 180.0)
-#define RADF(X) (float)RAD(X)
+#define RADF(X) ((float)(X) * (float)(M_PI / 180.0))
 
 #define KYU_SHIFT_UINT64(x, n) (((uint64_t)x) << (n))
 
@@ -107,10 +107,41 @@ extern "C" {
     COUNT
   } kyu_log_type;
 
+  /* Severity of a log type: 0 for LOG, 1 for WARNING, 2 for ERROR and
+     the same for their GL counterparts */
+#define KYU_LOG_SEVERITY(TYPE) ((int)(TYPE) % 3)
+
+#define KYU_LOG_LEVEL_ALL     0
+#define KYU_LOG_LEVEL_WARNING 1
+#define KYU_LOG_LEVEL_ERROR   2
+#define KYU_LOG_LEVEL_NONE    3
+
+  /* Messages below this level are compiled out of the KYU_LOG macros */
+#ifndef KYU_LOG_MIN_LEVEL
+#define KYU_LOG_MIN_LEVEL KYU_LOG_LEVEL_ALL
+#endif
+
+  /* Messages a call site may log per second before it is muted */
+#define KYU_LOG_RATE 20
+
+  /* kyu_log only formats the message and queues it, a background thread
+     started by kyu_log_init writes it. Without that thread (before
+     kyu_init, on the PS2) messages are written right away. The queue is
+     flushed on exit, on a failed assertion and on a crash signal. */
   void kyu_log(kyu_log_type type, const char *restrict file, int line,
                const char *restrict message, ...);
-
-#define _KYU_LOG(X, ...) kyu_log(X, __FILE__, __LINE__, __VA_ARGS__)
+  int  kyu_log_init(void);
+  void kyu_log_quit(void);
+  void kyu_log_flush(void);
+  void kyu_log_set_level(int level);
+
+#define _KYU_LOG(X, ...)                                \
+  do                                                    \
+    {                                                   \
+      if (KYU_LOG_SEVERITY(X) >= KYU_LOG_MIN_LEVEL)     \
+        kyu_log(X, __FILE__, __LINE__, __VA_ARGS__);    \
+    }                                                   \
+  while (0)
 #define KYU_LOG(TYPE, ...) _KYU_LOG(TYPE, __VA_ARGS__)
 #define KYU_LOG_WARNING(...) _KYU_LOG(WARNING, __VA_ARGS__)
 #define KYU_LOG_ERROR(...) _KYU_LOG(ERROR, __VA_ARGS__)
@@ -132,6 +163,7 @@ extern "C" {
     if ((COND) == 0)                \
       {                             \
         KYU_LOG_ERROR(__VA_ARGS__); \
+        kyu_log_flush();            \
         KYU_BREAK;                  \
       }                             \
   }
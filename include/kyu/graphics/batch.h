@@ -0,0 +1,101 @@
+/* batch -- many meshes drawn with one indirect call
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_BATCH_H
+#define KYU_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/graphics/gl.h"
+#include "kyu/graphics/gpu_mesh.h"
+#include "kyu/graphics/instance.h"
+#include "kyu/graphics/mesh.h"
+
+  /* Every mesh of a batch has all the attributes, colors default to white */
+#define KYU_BATCH_ATTRIBUTES (KYU_GPU_MESH_COLORS | KYU_GPU_MESH_NORMALS | KYU_GPU_MESH_UVS)
+
+  /* Same layout as OpenGL's DrawElementsIndirectCommand */
+  typedef struct {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint  base_vertex;
+    GLuint base_instance;
+  } kyu_draw_command;
+
+  /* Where a mesh lies in the shared buffers */
+  typedef struct {
+    GLuint first_index;
+    GLuint nb_indices;
+    GLint  base_vertex;
+  } kyu_batch_mesh;
+
+  /* One vertex and one 32-bit index buffer hold all the meshes. Each
+     frame the draws are gathered on the CPU and submitted at once, a draw
+     reads its kyu_instance through its base instance, so shaders written
+     for kyu/graphics/instance.h work unchanged. */
+  typedef struct {
+    GLuint vao;
+    GLuint vbo;
+    GLuint ibo;
+    GLuint commands_buffer;
+    GLuint instances_buffer;
+
+    int nb_vertices;
+    int vertex_capacity;
+    int nb_indices;
+    int index_capacity;
+
+    kyu_batch_mesh *meshes;
+    int nb_meshes;
+    int mesh_capacity;
+
+    /* Gathered since the last submit */
+    kyu_draw_command *commands;
+    int nb_commands;
+    int command_capacity;
+
+    kyu_instance *instances;
+    int nb_instances;
+    int instance_capacity;
+
+    long triangles;
+  } kyu_batch;
+
+  int  kyu_batch_init(kyu_batch *batch);
+  void kyu_batch_release(kyu_batch *batch);
+
+  /* Copies the mesh into the shared buffers, which grow when needed.
+     Returns the id to draw it with, -1 on failure. */
+  int kyu_batch_add(kyu_batch *batch, const kyu_mesh *mesh);
+
+  /* Queues one instance of a mesh. Consecutive draws of the same mesh
+     share one command. */
+  int kyu_batch_draw(kyu_batch *batch, int mesh, const kyu_instance *instance);
+
+  /* Uploads the queued draws and submits them with one
+     glMultiDrawElementsIndirect, then empties the queue. Before OpenGL
+     4.3 the commands are drawn one by one. */
+  void kyu_batch_submit(kyu_batch *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_BATCH_H */
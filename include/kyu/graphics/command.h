@@ -0,0 +1,94 @@
+/* command -- recorded draws submitted in sorted order
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_COMMAND_H
+#define KYU_COMMAND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/graphics/gl.h"
+#include "kyu/graphics/gpu_mesh.h"
+#include "kyu/graphics/instance.h"
+#include "kyu/graphics/uniform.h"
+
+#include <stdint.h>
+
+  /* Everything a draw needs, the blocks are offsets in the uniform ring
+     given to kyu_command_list_submit, -1 when the draw has none */
+  typedef struct {
+    GLuint program;
+    kyu_gpu_mesh *mesh;
+
+    /* Drawn once per instance when set */
+    kyu_instances *instances;
+
+    /* Sorted on, draws of the same material share its block */
+    int material;
+    GLintptr material_block;
+    GLsizeiptr material_size;
+
+    GLintptr draw_block;
+    GLsizeiptr draw_size;
+
+    /* View depth from 0, near, to 1, far */
+    float depth;
+
+    /* Blended after every opaque draw, depth writes off */
+    int transparent;
+  } kyu_draw_packet;
+
+  /* Opaque draws come first, grouped by program, material then mesh and
+     front to back inside a group. Transparent ones follow from back to
+     front. Names too large for their bits only group less well. */
+  uint64_t kyu_draw_key(const kyu_draw_packet *packet);
+
+  typedef struct {
+    uint64_t key;
+    int packet;
+  } kyu_command_key;
+
+  /* Recorded by one thread, each thread can fill its own list */
+  typedef struct {
+    kyu_draw_packet *packets;
+    int nb_packets;
+    int capacity;
+
+    /* In recording order, sorted order after a sort */
+    kyu_command_key *keys;
+    kyu_command_key *scratch;
+  } kyu_command_list;
+
+  int  kyu_command_list_init(kyu_command_list *list, int capacity);
+  void kyu_command_list_release(kyu_command_list *list);
+
+  /* Copies the packet, returns -1 when the list can't grow */
+  int kyu_command_list_record(kyu_command_list *list, const kyu_draw_packet *packet);
+
+  /* Radix sort on the keys, packets stay where they were recorded */
+  void kyu_command_list_sort(kyu_command_list *list);
+
+  /* Sorts, draws and empties the list. Returns how many times the
+     program, material or mesh changed between draws. */
+  int kyu_command_list_submit(kyu_command_list *list, const kyu_uniform_ring *uniforms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_COMMAND_H */
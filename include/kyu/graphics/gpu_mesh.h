@@ -0,0 +1,97 @@
+/* gpu_mesh -- upload of meshes to OpenGL buffers
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_GPU_MESH_H
+#define KYU_GPU_MESH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/graphics/gl.h"
+#include "kyu/graphics/mesh.h"
+
+#include <stddef.h>
+
+  /* Vertex shader inputs: layout (location = KYU_ATTRIB_...) */
+#define KYU_ATTRIB_POSITION 0 /* vec3, or vec4 with w = 1 */
+#define KYU_ATTRIB_COLOR    1 /* vec4, normalized bytes */
+#define KYU_ATTRIB_NORMAL   2 /* vec3 */
+#define KYU_ATTRIB_UV       3 /* vec2 */
+
+  /* Per-instance inputs of kyu/graphics/instance.h */
+#define KYU_ATTRIB_INSTANCE_MATRIX 4 /* mat4, one column per location to 7 */
+#define KYU_ATTRIB_INSTANCE_COLOR  8 /* vec4 */
+
+  /* Attributes stored in the vertex buffer */
+#define KYU_GPU_MESH_COLORS  0x1
+#define KYU_GPU_MESH_NORMALS 0x2
+#define KYU_GPU_MESH_UVS     0x4
+
+  typedef struct {
+    GLuint vao;
+    GLuint vbo;
+    GLuint ibo;
+
+    GLenum index_type;
+    int nb_vertices;
+    int nb_indices;
+    int stride;
+    int attributes;
+
+    /* Instance buffer whose layout the VAO holds */
+    GLuint instances;
+
+    /* Vertex and index buffers together */
+    size_t bytes;
+  } kyu_gpu_mesh;
+
+  /* Corners sharing a position, normal and uv become one interleaved
+     vertex. Indices are 16 bits when the vertex count allows it. Colors
+     come from mesh->colors, one per position, when the mesh has them. */
+  int  kyu_gpu_mesh_init(kyu_gpu_mesh *gpu, const kyu_mesh *mesh);
+  void kyu_gpu_mesh_release(kyu_gpu_mesh *gpu);
+
+  /* Binds the VAO and draws every triangle */
+  void kyu_gpu_mesh_draw(const kyu_gpu_mesh *gpu);
+
+  /* The interleaved arrays kyu_gpu_mesh_init uploads, for meshes sharing
+     buffers. Attributes missing from the mesh are zero, colors white. */
+  typedef struct {
+    unsigned char *vertices;
+    unsigned int *indices;
+    int nb_vertices;
+    int nb_indices;
+    int stride;
+    int attributes;
+  } kyu_mesh_data;
+
+  int  kyu_mesh_data_build(kyu_mesh_data *data, const kyu_mesh *mesh, int attributes);
+  void kyu_mesh_data_release(kyu_mesh_data *data);
+
+  /* KYU_GPU_MESH_* attributes the mesh has */
+  int  kyu_vertex_attributes(const kyu_mesh *mesh);
+  int  kyu_vertex_stride(int attributes);
+
+  /* Attribute pointers into the bound GL_ARRAY_BUFFER, for the bound VAO */
+  void kyu_vertex_layout(int attributes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_GPU_MESH_H */
@@ -0,0 +1,70 @@
+/* instance -- instanced drawing of GPU meshes
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_INSTANCE_H
+#define KYU_INSTANCE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/graphics/gl.h"
+#include "kyu/graphics/gpu_mesh.h"
+#include "kyu/math/matrix.h"
+#include "kyu/math/vector.h"
+
+  /* Read by the vertex shader as
+       layout (location = 4) in mat4 instance_matrix;
+       layout (location = 8) in vec4 instance_color;
+     see shaders/instanced_vertex.glsl. The matrix is column-major. */
+  typedef struct {
+    float matrix[16];
+    float color[4];
+  } kyu_instance;
+
+  /* Rewritten every frame, each map orphans the previous contents so the
+     GPU never makes the CPU wait */
+  typedef struct {
+    GLuint vbo;
+    int capacity;
+    int count;
+  } kyu_instances;
+
+  int  kyu_instances_init(kyu_instances *instances, int capacity);
+  void kyu_instances_release(kyu_instances *instances);
+
+  /* Room for `count` instances, the buffer grows when needed. Nothing
+     may be drawn with the buffer until it is unmapped. */
+  kyu_instance *kyu_instances_map(kyu_instances *instances, int count);
+  void kyu_instances_unmap(kyu_instances *instances);
+
+  /* From a row-major kyu_matrix 4x4 */
+  void kyu_instance_set(kyu_instance *instance, const kyu_matrix *matrix,
+                        kyu_color color);
+
+  /* One draw call for the instances of the last map */
+  void kyu_instances_draw(kyu_instances *instances, kyu_gpu_mesh *gpu);
+
+  /* Attribute pointers into the bound GL_ARRAY_BUFFER, one kyu_instance
+     per instance, for the bound VAO */
+  void kyu_instance_layout(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_INSTANCE_H */
@@ -30,7 +30,7 @@ typedef struct {
   int uvs[3];
 } kyu_triangle;
 
-typedef struct {
+typedef struct kyu_mesh {
   kyu_point     *vertices;
   kyu_vec       *normals;
   kyu_vec2      *uvs;
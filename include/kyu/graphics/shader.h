@@ -27,11 +27,54 @@ extern "C" {
 #ifndef __KYU_PS2__
 #include "kyu/graphics/gl.h"
 #endif
+
+#include <stdint.h>
   
+  /* Programs are loaded from the shader cache when it holds one for the
+     same sources and driver, they are compiled and stored there
+     otherwise. Returns 0 when linking failed. */
   GLuint read_shaders(const char *restrict vertex_file,
                       const char *restrict fragment_file);
   int create_shader(const char *filename, const GLuint type);
 
+  /* A zeroed kyu_program is idle until submitted */
+  typedef enum {
+    KYU_PROGRAM_IDLE,
+    KYU_PROGRAM_PENDING,
+    KYU_PROGRAM_READY,
+    KYU_PROGRAM_FAILED
+  } kyu_program_status;
+
+  typedef struct {
+    /* Usable once ready, 0 when it failed */
+    GLuint program;
+    kyu_program_status status;
+
+    GLuint vertex_shader;
+    GLuint fragment_shader;
+    int stage;
+    int cached;
+    uint64_t key;
+  } kyu_program;
+
+  /* Starts compiling without waiting for the driver, submitting every
+     program before polling any lets it compile them in parallel. Found
+     in the shader cache, the program is ready right away. */
+  int kyu_program_submit(kyu_program *program, const char *vertex_file,
+                         const char *fragment_file);
+
+  /* Never blocks with KHR_parallel_shader_compile, the app can render a
+     loading screen between polls. `program` is valid once ready. */
+  kyu_program_status kyu_program_poll(kyu_program *program);
+  kyu_program_status kyu_program_wait(kyu_program *program);
+
+  /* Polls them all, returns how many are still pending */
+  int kyu_programs_poll(kyu_program *programs, int count);
+
+  /* Directory of the program binaries, created if needed, NULL turns
+     the cache off. It is off until then. */
+  int kyu_set_shader_cache(const char *directory);
+
 #ifdef __cplusplus
 }
 #endif
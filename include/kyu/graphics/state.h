@@ -0,0 +1,74 @@
+/* state -- cached OpenGL bindings and uniform locations
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_STATE_H
+#define KYU_STATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/graphics/gl.h"
+
+  /* Texture units whose bindings are cached, others are always bound */
+#define KYU_GL_TEXTURE_UNITS 16
+
+  /* Indexed uniform buffer bindings whose ranges are cached */
+#define KYU_GL_UNIFORM_BINDINGS 16
+
+  /* Longest uniform name kept in the location cache */
+#define KYU_GL_UNIFORM_NAME 64
+
+  /* Each call is skipped when the value it sets is already the current
+     one. The cache mirrors the context of the render thread: state
+     changed with plain gl* calls must be followed by
+     kyu_gl_state_reset, which kyu_init does for the new context. */
+  void kyu_gl_state_reset(void);
+
+  void kyu_gl_use_program(GLuint program);
+  void kyu_gl_bind_vertex_array(GLuint vao);
+  void kyu_gl_bind_buffer(GLenum target, GLuint buffer);
+  void kyu_gl_bind_texture(GLuint unit, GLenum target, GLuint texture);
+
+  /* Also binds the buffer to the generic target, as OpenGL does */
+  void kyu_gl_bind_buffer_range(GLenum target, GLuint index, GLuint buffer,
+                                GLintptr offset, GLsizeiptr size);
+
+  void kyu_gl_enable(GLenum cap);
+  void kyu_gl_disable(GLenum cap);
+  void kyu_gl_blend_func(GLenum source, GLenum destination);
+  void kyu_gl_depth_func(GLenum func);
+  void kyu_gl_depth_mask(GLboolean write);
+
+  /* Deleting unbinds, names can then be reused by the driver */
+  void kyu_gl_delete_program(GLuint program);
+  void kyu_gl_delete_vertex_arrays(GLsizei n, const GLuint *vaos);
+  void kyu_gl_delete_buffers(GLsizei n, const GLuint *buffers);
+  void kyu_gl_delete_textures(GLsizei n, const GLuint *textures);
+
+  /* Called by read_shaders once the program is linked, every active
+     uniform is looked up then */
+  void kyu_gl_cache_uniforms(GLuint program);
+
+  /* From the cache, names it misses are asked to the driver once */
+  GLint kyu_gl_uniform_location(GLuint program, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_STATE_H */
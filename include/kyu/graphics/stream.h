@@ -0,0 +1,77 @@
+/* stream -- persistently mapped buffers for per-frame data
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_STREAM_H
+#define KYU_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/graphics/gl.h"
+
+  /* Frames the GPU may lag behind before a begin waits for it */
+#define KYU_STREAM_REGIONS 3
+
+  /* One buffer split in KYU_STREAM_REGIONS regions, a frame writes to
+     one of them while the GPU reads the others. A region gets a fence
+     when the frame after it begins, and is waited on only when it comes
+     back around. The buffer is created with glBufferStorage and stays
+     mapped; before OpenGL 4.4 regions are mapped unsynchronized between
+     the first alloc and the commit instead. */
+  typedef struct {
+    GLuint buffer;
+    GLsizeiptr region_size;
+    GLint alignment;
+    int persistent;
+
+    int region;
+    GLsizeiptr offset;
+    GLsync fences[KYU_STREAM_REGIONS];
+
+    /* Whole buffer when persistent. Otherwise the mapped part of the
+       region, from `mapped` in it to its end. */
+    unsigned char *data;
+    GLsizeiptr mapped;
+
+    /* Region size asked by a frame that did not fit, from the next begin */
+    GLsizeiptr wanted;
+  } kyu_stream;
+
+  /* Allocations start at multiples of `alignment` from the buffer
+     start: with the vertex stride, draws can start at offset / stride */
+  int  kyu_stream_init(kyu_stream *stream, GLsizeiptr region_size, GLint alignment);
+  void kyu_stream_release(kyu_stream *stream);
+
+  /* Moves to the next region, the GPU must be done with it. A begin
+     that grows the stream replaces `buffer`, VAOs reading it from their
+     attribute bindings must then be pointed to the new one. */
+  int kyu_stream_begin(kyu_stream *stream);
+
+  /* Room for `size` bytes at `offset` in the buffer, NULL when the
+     region is full: it grows at the next begin */
+  void *kyu_stream_alloc(kyu_stream *stream, GLsizeiptr size, GLintptr *offset);
+
+  /* What was written is seen by the commands issued from now on. More
+     allocations may follow in the same frame. */
+  void kyu_stream_commit(kyu_stream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_STREAM_H */
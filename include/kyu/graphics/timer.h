@@ -0,0 +1,64 @@
+/* timer -- GPU time of the frame and of named passes
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_TIMER_H
+#define KYU_TIMER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/graphics/gl.h"
+
+/* Queries of a frame are read this many frames later, by then the GPU
+   is done with them and nothing waits */
+#define KYU_GPU_TIMER_FRAMES 3
+
+/* Per frame, the passes after that are not timed */
+#define KYU_GPU_TIMER_PASSES 32
+
+  typedef struct {
+    const char *name;
+    double seconds;
+  } kyu_gpu_pass;
+
+  /* Called by kyu_run around the render. The GPU time from the first to
+     the last command of the render goes to KYU_STAT_GPU, next to the
+     CPU series of kyu/core/stats.h. It counts the time the GPU waited
+     for commands too: a GPU time close to the render time with a short
+     swap points at the CPU. */
+  void kyu_gpu_frame_begin(void);
+  void kyu_gpu_frame_end(void);
+
+  /* Frees the queries, the context must still be current */
+  void kyu_gpu_timers_release(void);
+
+  /* Times the commands issued between the two calls. Passes can't be
+     nested, the name must stay valid until the results are read. */
+  void kyu_gpu_pass_begin(const char *name);
+  void kyu_gpu_pass_end(void);
+
+  /* The passes of the latest frame whose results arrived, in the order
+     they ran, and the frame they come from. Valid until the next
+     kyu_gpu_frame_begin. */
+  int kyu_gpu_passes(const kyu_gpu_pass **passes, long *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_TIMER_H */
@@ -0,0 +1,67 @@
+/* uniform -- per-frame uniform buffer ring
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_UNIFORM_H
+#define KYU_UNIFORM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/graphics/gl.h"
+#include "kyu/graphics/stream.h"
+
+  /* Uniform block bindings: layout (std140, binding = KYU_UNIFORM_...) */
+#define KYU_UNIFORM_FRAME    0 /* camera, time */
+#define KYU_UNIFORM_DRAW     1 /* transforms */
+#define KYU_UNIFORM_MATERIAL 2
+
+  /* Between begin and end the blocks of the frame are written linearly
+     in a region of a kyu_stream, each one at the driver's offset
+     alignment. Draws bind their blocks with kyu_uniform_ring_bind once
+     the ring is ended. */
+  typedef struct {
+    kyu_stream stream;
+  } kyu_uniform_ring;
+
+  /* `size` is per frame, KYU_STREAM_REGIONS frames are kept */
+  int  kyu_uniform_ring_init(kyu_uniform_ring *ring, GLsizeiptr size);
+  void kyu_uniform_ring_release(kyu_uniform_ring *ring);
+
+  int  kyu_uniform_ring_begin(kyu_uniform_ring *ring);
+  void kyu_uniform_ring_end(kyu_uniform_ring *ring);
+
+  /* Room for `size` bytes at the returned offset, NULL when the ring is
+     full: it grows at the next begin */
+  void *kyu_uniform_ring_alloc(kyu_uniform_ring *ring, GLsizeiptr size,
+                               GLintptr *offset);
+
+  /* Copies the block, returns its offset or -1 */
+  GLintptr kyu_uniform_ring_push(kyu_uniform_ring *ring, const void *block,
+                                 GLsizeiptr size);
+
+  void kyu_uniform_ring_bind(const kyu_uniform_ring *ring, GLuint binding,
+                             GLintptr offset, GLsizeiptr size);
+
+  /* For GLSL 3.30 shaders, which can't give the binding in the layout */
+  int kyu_uniform_block_binding(GLuint program, const char *name, GLuint binding);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_UNIFORM_H */
@@ -20,15 +20,34 @@
 
 #include "kyu/core/version.h"
 #include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
 #include "kyu/core/base.h"
+#include "kyu/core/job.h"
+#include "kyu/core/frame.h"
+#include "kyu/core/clock.h"
+#include "kyu/core/profile.h"
+#include "kyu/core/stats.h"
+#include "kyu/core/metrics.h"
 
 #ifndef __KYU_PS2__
 #include "kyu/graphics/gl.h"
 #include "kyu/graphics/shader.h"
+#include "kyu/graphics/state.h"
+#include "kyu/graphics/stream.h"
+#include "kyu/graphics/uniform.h"
+#include "kyu/graphics/gpu_mesh.h"
+#include "kyu/graphics/instance.h"
+#include "kyu/graphics/batch.h"
+#include "kyu/graphics/command.h"
+#include "kyu/graphics/timer.h"
 #endif
 #include "kyu/graphics/mesh.h"
 
 #include "kyu/math/vector.h"
+#include "kyu/math/vector_array.h"
 #include "kyu/math/matrix.h"
+#include "kyu/math/ray.h"
+#include "kyu/math/frustum.h"
+#include "kyu/math/trig.h"
 
 #endif /* KYU_H */
@@ -0,0 +1,60 @@
+/* frustum -- view frustum extraction and culling
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_FRUSTUM_H
+#define KYU_FRUSTUM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/math/vector.h"
+#include "kyu/math/matrix.h"
+
+typedef enum {
+  KYU_CULL_OUTSIDE,
+  KYU_CULL_INTERSECT,
+  KYU_CULL_INSIDE
+} kyu_cull_result;
+
+/* Planes are stored as (a, b, c, d) in (x, y, z, w) with normalized
+   normals pointing inside: left, right, bottom, top, near, far */
+typedef struct {
+  kyu_vec planes[6];
+} kyu_frustum;
+
+typedef struct {
+  kyu_point min;
+  kyu_point max;
+} kyu_aabb;
+
+kyu_frustum kyu_frustum_from_matrix(kyu_matrix *view_proj);
+
+/* Spheres are given as (center, radius) in (x, y, z, w). The class of
+   each object is written in `results` and the indices of the ones that
+   are not outside in `visible`, both can be NULL. Returns the number of
+   visible objects. */
+int kyu_frustum_cull_spheres(kyu_frustum *frustum, kyu_vec *spheres, int count,
+                             unsigned char *results, int *visible);
+int kyu_frustum_cull_aabbs(kyu_frustum *frustum, kyu_aabb *boxes, int count,
+                           unsigned char *results, int *visible);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_FRUSTUM_H */
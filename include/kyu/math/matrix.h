@@ -40,6 +40,11 @@ kyu_matrix *kyu_matrix_identity4x4();
 kyu_matrix *kyu_matrix_identity3x4();
 kyu_matrix *kyu_matrix_identity4x3();
 
+/* Released by the frame arena two ticks later, kyu_matrix_release
+   refuses them */
+kyu_matrix *kyu_matrix_frame_init(int height, int width);
+kyu_matrix *kyu_matrix_frame_init4x4();
+
 int kyu_matrix_release(kyu_matrix *matrix);
 
 kyu_matrix *kyu_matrix_from_vec(kyu_vec *vec);
@@ -61,12 +66,29 @@ void kyu_matrix_mult(kyu_matrix *dest, kyu_matrix *a, kyu_matrix *b);
 void kyu_matrix_mult_vec(kyu_matrix *dest, kyu_matrix *a, kyu_vec *b);
 void kyu_matrix_mult_vec2(kyu_matrix *dest, kyu_matrix *a, kyu_vec *b);
 
+/* Inverses return 0 on success and -1 on a bad size or a singular matrix.
+   The rigid and affine versions take a 4x4 or 3x4 matrix whose last row
+   is assumed to be (0, 0, 0, 1); the normal matrix is the 3x3
+   inverse-transpose of the upper-left 3x3 block of `matrix`. */
+int kyu_matrix_inverse(kyu_matrix *dest, kyu_matrix *matrix);
+int kyu_matrix_inverse_affine(kyu_matrix *dest, kyu_matrix *matrix);
+int kyu_matrix_inverse_rigid(kyu_matrix *dest, kyu_matrix *matrix);
+int kyu_matrix_normal(kyu_matrix *dest, kyu_matrix *matrix);
+
 kyu_matrix *kyu_matrix_translate(float x, float y, float z);
 kyu_matrix *kyu_matrix_translate_vec(kyu_vec *vec);
 kyu_matrix *kyu_matrix_rotateX(float angle);
 kyu_matrix *kyu_matrix_rotateY(float angle);
 kyu_matrix *kyu_matrix_rotateZ(float angle);
 
+/* Same as above, in place on a 4x4 matrix */
+void kyu_matrix_set_identity(kyu_matrix *matrix);
+void kyu_matrix_set_translate(kyu_matrix *matrix, float x, float y, float z);
+void kyu_matrix_set_translate_vec(kyu_matrix *matrix, kyu_vec *vec);
+void kyu_matrix_set_rotateX(kyu_matrix *matrix, float angle);
+void kyu_matrix_set_rotateY(kyu_matrix *matrix, float angle);
+void kyu_matrix_set_rotateZ(kyu_matrix *matrix, float angle);
+
 void kyu_matrix_fprint(FILE *stream, kyu_matrix *matrix);
 void kyu_matrix_print(kyu_matrix *matrix);
 
@@ -0,0 +1,80 @@
+/* ray -- ray-triangle intersection
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_RAY_H
+#define KYU_RAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/math/vector.h"
+
+/* kyu/graphics/mesh.h, only ray.c needs its fields */
+struct kyu_mesh;
+
+#define KYU_RAY_PACKET 8
+
+typedef struct {
+  kyu_point origin;
+  kyu_vec   direction;
+} kyu_ray;
+
+/* KYU_RAY_PACKET triangles in SoA layout, stored as their first vertex
+   and their two edges. Unused lanes are zeroed and never hit. */
+typedef struct {
+  float v0[3][KYU_RAY_PACKET];
+  float e1[3][KYU_RAY_PACKET];
+  float e2[3][KYU_RAY_PACKET];
+} kyu_triangle_packet;
+
+typedef struct {
+  kyu_triangle_packet *packets;
+
+  int nb_packets;
+  int nb_triangles;
+} kyu_ray_mesh;
+
+kyu_ray kyu_ray_init(kyu_point *origin, kyu_vec *direction);
+
+kyu_ray_mesh *kyu_ray_mesh_init(struct kyu_mesh *mesh);
+void kyu_ray_mesh_release(kyu_ray_mesh *mesh);
+
+/* Möller-Trumbore test of one ray against a packet. Returns a bit mask of
+   the lanes hit in ]0, t_max[ and writes their distances in `t` (misses
+   get t_max). The SSE variant processes the packet as two groups of 4
+   lanes, the AVX2 one as a single group of 8; a variant that was not
+   compiled in falls back to the next narrower one. All variants give the
+   same results up to float rounding. */
+int kyu_ray_intersect_packet(kyu_ray *ray, kyu_triangle_packet *packet,
+                             float t_max, float *t);
+int kyu_ray_intersect_packet_scalar(kyu_ray *ray, kyu_triangle_packet *packet,
+                                    float t_max, float *t);
+int kyu_ray_intersect_packet_sse(kyu_ray *ray, kyu_triangle_packet *packet,
+                                 float t_max, float *t);
+int kyu_ray_intersect_packet_avx2(kyu_ray *ray, kyu_triangle_packet *packet,
+                                  float t_max, float *t);
+
+/* Closest hit along the ray, returns the triangle index or -1 */
+int kyu_ray_intersect_mesh(kyu_ray *ray, kyu_ray_mesh *mesh,
+                           float t_max, float *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_RAY_H */
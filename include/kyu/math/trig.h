@@ -0,0 +1,39 @@
+/* trig -- fast trigonometric functions
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_TRIG_H
+#define KYU_TRIG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sine and cosine of an angle in radians, computed together with a
+   minimax polynomial after reduction to [-pi/4, pi/4]. The maximum
+   absolute error is below 1e-7 for |x| <= 8192 (KYU_SINCOS_RANGE);
+   outside of that range both versions fall back to libm, lane by lane
+   for the 4-wide one. kyu_sincos4 works on arrays of 4 floats. */
+#define KYU_SINCOS_RANGE 8192.f
+
+void kyu_sincos(float x, float *s, float *c);
+void kyu_sincos4(const float *x, float *s, float *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_TRIG_H */
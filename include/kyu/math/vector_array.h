@@ -0,0 +1,60 @@
+/* vector_array -- bulk operations on arrays of vectors
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_VECTOR_ARRAY_H
+#define KYU_VECTOR_ARRAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "kyu/math/vector.h"
+
+/* Structure of arrays: the components of the i-th vector are x[i], y[i]
+   and z[i] */
+typedef struct {
+  float *x;
+  float *y;
+  float *z;
+} kyu_vec_soa;
+
+/* Points the three arrays to `count` floats each from the frame arena */
+int kyu_vec_soa_frame_init(kyu_vec_soa *soa, int count);
+
+/* Same results as the per-vector functions of vector.h, applied to
+   `count` elements. The destination can alias the sources. */
+void kyu_vec_array_add(kyu_vec *dest, kyu_vec *a, kyu_vec *b, int count);
+void kyu_vec_array_sub(kyu_vec *dest, kyu_vec *a, kyu_vec *b, int count);
+void kyu_vec_array_mult(kyu_vec *dest, float a, kyu_vec *b, int count);
+void kyu_vec_array_dot(float *dest, kyu_vec *a, kyu_vec *b, int count);
+void kyu_vec_array_cross(kyu_vec *dest, kyu_vec *a, kyu_vec *b, int count);
+void kyu_vec_array_normalize(kyu_vec *dest, kyu_vec *v, int count);
+void kyu_vec_array_length(float *dest, kyu_vec *v, int count);
+
+void kyu_vec_soa_add(kyu_vec_soa *dest, kyu_vec_soa *a, kyu_vec_soa *b, int count);
+void kyu_vec_soa_sub(kyu_vec_soa *dest, kyu_vec_soa *a, kyu_vec_soa *b, int count);
+void kyu_vec_soa_mult(kyu_vec_soa *dest, float a, kyu_vec_soa *b, int count);
+void kyu_vec_soa_dot(float *dest, kyu_vec_soa *a, kyu_vec_soa *b, int count);
+void kyu_vec_soa_cross(kyu_vec_soa *dest, kyu_vec_soa *a, kyu_vec_soa *b, int count);
+void kyu_vec_soa_normalize(kyu_vec_soa *dest, kyu_vec_soa *v, int count);
+void kyu_vec_soa_length(float *dest, kyu_vec_soa *v, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KYU_VECTOR_ARRAY_H */
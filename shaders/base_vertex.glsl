@@ -3,7 +3,11 @@
 layout (location = 0) in vec4 position;
 layout (location = 1) in vec3 color;
 
-uniform mat4 mat;
+/* KYU_UNIFORM_DRAW, kyu matrices are row-major */
+layout (std140, row_major) uniform draw
+{
+  mat4 mat;
+};
 
 out vec3 f_color;
 
@@ -0,0 +1,16 @@
+#version 330
+
+layout (location = 0) in vec4 position;
+layout (location = 1) in vec4 color;
+layout (location = 4) in mat4 instance_matrix;
+layout (location = 8) in vec4 instance_color;
+
+uniform mat4 mat;
+
+out vec3 f_color;
+
+void main()
+{
+  f_color = color.rgb * instance_color.rgb;
+  gl_Position = mat * instance_matrix * position;
+}
@@ -15,10 +15,22 @@
    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
 
 #include "kyu/core/base.h"
+#include "kyu/core/job.h"
+#include "kyu/core/frame.h"
+#include "kyu/core/clock.h"
+#include "kyu/core/profile.h"
+#include "kyu/core/memory.h"
+#include "kyu/core/stats.h"
+#include "kyu/core/metrics.h"
+#include "core/thread.h"
+#include "core/snapshot.h"
 
 #ifndef __KYU_PS2__
 #  include <GLFW/glfw3.h>
 #  include "utils/glfw_utility.h"
+#  include "core/headless.h"
+#  include "kyu/graphics/state.h"
+#  include "kyu/graphics/timer.h"
 #else
 #  include <graph.h>
 #  include <dma.h>
@@ -34,6 +46,7 @@ float g_screen_x  = 0.f;
 float g_screen_y  = 0.f;
 #endif
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -47,6 +60,26 @@ float g_screen_y  = 0.f;
 struct kyu_app {
 #ifndef __KYU_PS2__
   GLFWwindow *window;
+  int width;
+  int height;
+
+  int headless;
+  long frames;
+  kyu_headless offscreen;
+
+  kyu_snapshots snapshots;
+  void *snapshot;
+  int has_snapshots;
+  void (*publish)(void *);
+  void (*interpolate)(void *, const void *, const void *, double);
+
+  int threaded_update;
+  kyu_thread update_thread;
+  kyu_atomic running;
+
+  double frame_period;
+  kyu_vsync vsync;
+  int max_updates;
 #else
   framebuffer_t fb;
   zbuffer_t z;
@@ -56,8 +89,24 @@ struct kyu_app {
   void (*quit)();
   void (*update)();
   void *(*render)(void *);
+
+  kyu_arena update_arena;
+  kyu_arena render_arena;
+
+  const char *stats_file;
+
+  long allocation_mark;
+  long frame_allocations;
+#ifndef NDEBUG
+  int warmup_frames;
+#endif
 };
 
+static kyu_app *create_app(int width, int height, const char *name, long frames,
+                           void (*init)(), void (*quit)(), void (*update)(),
+                           void *(*render)(void *));
+static void count_allocations(kyu_app *app);
+
 #ifndef __KYU_PS2__
 #ifndef NDEBUG
 static void kyu_glad_pre_callback(const char *name, void *funcptr, int len_args, ...);
@@ -68,16 +117,57 @@ static void APIENTRY kyu_log_error_callback(GLenum source, GLenum type, GLuint i
 
 static unsigned char suppress_glad_callback = 0;
 #endif /* !NDEBUG */
+
+static GLFWwindow *create_window(int width, int height, const char *name);
+static int   should_close(kyu_app *app, long frame);
+static void  run_updates(kyu_app *app, double *last_time, double *delta_time);
+static void  publish_snapshot(kyu_app *app, double time);
+static void *prepare_snapshot(kyu_app *app, double alpha);
+static void *update_thread(void *data);
 #endif /* !__KYU_PS2__ */
 
+#define KYU_UPDATE_STEP (1.0 / KYU_FRAMERATE)
+
 double kyu_deltatime = 0.0;
 
 kyu_app *
 kyu_init(int width, int height, const char *name,
          void (*init)(), void (*quit)(), void (*update)(), void *(*render)(void *))
+{
+  return create_app(width, height, name, 0, init, quit, update, render);
+}
+
+kyu_app *
+kyu_init_headless(int width, int height, long frames,
+                  void (*init)(), void (*quit)(), void (*update)(), void *(*render)(void *))
+{
+  KYU_ASSERT(frames > 0, "A headless run needs a number of frames");
+  if (frames <= 0)
+    return NULL;
+
+#ifndef __KYU_PS2__
+  return create_app(width, height, NULL, frames, init, quit, update, render);
+#else
+  (void)width;
+  (void)height;
+  (void)init;
+  (void)quit;
+  (void)update;
+  (void)render;
+  KYU_LOG_ERROR("The PS2 has no headless mode");
+  return NULL;
+#endif /* !__KYU_PS2__ */
+}
+
+static kyu_app *
+create_app(int width, int height, const char *name, long frames,
+           void (*init)(), void (*quit)(), void (*update)(), void *(*render)(void *))
 {
   (void)name;
-  kyu_app *app = malloc(sizeof(kyu_app));
+  (void)frames;
+  kyu_app *app = kyu_malloc(sizeof(kyu_app), KYU_MEMORY_CORE);
+
+  kyu_log_init();
 
   if (app == NULL)
     {
@@ -86,37 +176,25 @@ kyu_init(int width, int height, const char *name,
     }
   
 #ifndef __KYU_PS2__
-  GLFWwindow* window = NULL;
-
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-#ifndef NDEBUG
-  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
-#endif
-
-#ifdef __APPLE
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif /* __APPLE */
-  
-  window = glfwCreateWindow(width, height, name, NULL, NULL);
-  if (!window)
+  app->window   = NULL;
+  app->width    = width;
+  app->height   = height;
+  app->headless = (frames > 0);
+  app->frames   = frames;
+
+  /* Offscreen runs fail softly, a CI job can skip its GPU tests */
+  if (app->headless)
     {
-      glfwTerminate();
-      ERR_EXIT("Can't create a window...");
+      if (kyu_headless_init(&app->offscreen, width, height) != 0)
+        {
+          kyu_free(app);
+          return NULL;
+        }
     }
+  else
+    app->window = create_window(width, height, name);
 
-  /* Make the window's context current */
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, resize_callback);
-  glfwSetKeyCallback(window, input_callback);
-  
-  if (gladLoadGLLoader((GLADloadproc) glfwGetProcAddress) == 0)
-    {
-      glfwTerminate();
-      ERR_EXIT("Can't initialize GLAD...");
-    }
+  kyu_gl_state_reset();
 
 #ifndef NDEBUG
   glad_set_pre_callback(kyu_glad_pre_callback);
@@ -134,7 +212,16 @@ kyu_init(int width, int height, const char *name,
     }
 #endif /* !NDEBUG */
 
-  app->window = window;
+  app->snapshot        = NULL;
+  app->has_snapshots   = 0;
+  app->publish         = NULL;
+  app->interpolate     = NULL;
+  app->threaded_update = 0;
+  app->running         = 0;
+
+  app->frame_period = 0.0;
+  app->max_updates  = KYU_MAX_UPDATES;
+  kyu_set_vsync(app, KYU_VSYNC_ON);
 #else /* __KYU_PS2__ */
   qword_t *q = NULL;
   framebuffer_t fb = { 0 };
@@ -163,7 +250,7 @@ kyu_init(int width, int height, const char *name,
   graph_enable_output();
 
   if (g_buff == NULL)
-    g_buff = malloc(sizeof(qword_t) * KYU_BUFFER_SIZE);
+    g_buff = kyu_malloc(sizeof(qword_t) * KYU_BUFFER_SIZE, KYU_MEMORY_CORE);
   
   memset(g_buff, 0, KYU_BUFFER_SIZE);
   q = g_buff;
@@ -181,6 +268,34 @@ kyu_init(int width, int height, const char *name,
   app->quit   = quit;
   app->update = update;
   app->render = render;
+
+  app->stats_file = NULL;
+
+  /* A failed init leaves its arena empty, data[0] at NULL */
+  if (kyu_arena_init(&app->update_arena, KYU_FRAME_ARENA_SIZE) != 0
+      || kyu_arena_init(&app->render_arena, KYU_FRAME_ARENA_SIZE) != 0)
+    {
+      KYU_LOG_ERROR("Can't allocate the frame arenas");
+      if (app->update_arena.data[0] != NULL)
+        kyu_arena_release(&app->update_arena);
+#ifndef __KYU_PS2__
+      if (app->headless)
+        kyu_headless_release(&app->offscreen);
+      else
+        glfwTerminate();
+#endif
+      kyu_free(app);
+      return NULL;
+    }
+
+  if (kyu_job_init(KYU_JOB_AUTO) != 0)
+    KYU_LOG_WARNING("Can't start the job system");
+
+  app->allocation_mark = kyu_memory_allocations();
+  app->frame_allocations = 0;
+#ifndef NDEBUG
+  app->warmup_frames = (int)KYU_FRAMERATE;
+#endif
   
   return app;
 }
@@ -189,6 +304,7 @@ int
 kyu_run(kyu_app *app)
 {
   void *v = NULL;
+  double frame_start, start;
   
   KYU_ASSERT(app != NULL, "Pointer to kyu_app is NULL");
   if (app == NULL)
@@ -199,33 +315,58 @@ kyu_run(kyu_app *app)
       exit(EXIT_FAILURE);
     }
 
+  kyu_profile_thread_name("main");
+
+#ifndef __KYU_PS2__
+  /* Headless runs are reproducible, one update per frame */
+  if (app->headless && app->threaded_update)
+    {
+      KYU_LOG_WARNING("No threaded update in headless mode");
+      app->threaded_update = 0;
+    }
+#endif
+
+  KYU_PROFILE_BEGIN("init");
   if (app->init != NULL)
     app->init();
+  KYU_PROFILE_END();
+
+  kyu_stats_reset();
 
 #ifndef __KYU_PS2__
-  static double limit = 1.0 / KYU_FRAMERATE;
-  int updates, frames;
-  double last_time, now_time, delta_time, timer;
+  double last_time, delta_time, next_frame;
+  long frame = 0;
 
   kyu_deltatime = delta_time = 0.0;
-  timer = last_time = glfwGetTime();
-  updates = frames = 0;
+  last_time = kyu_clock_now();
+
+  /* The render always has a snapshot to interpolate from */
+  publish_snapshot(app, last_time);
 
-  while (!glfwWindowShouldClose(app->window))
+  frame_start = next_frame = kyu_clock_now();
+
+  kyu_atomic_store(&app->running, 1);
+  if (app->threaded_update
+      && kyu_thread_create(&app->update_thread, update_thread, app) != 0)
     {
-      now_time = glfwGetTime();
-      kyu_deltatime = (now_time - last_time);
-      delta_time += kyu_deltatime / limit;
-      last_time = now_time;
+      KYU_LOG_WARNING("Can't create the update thread, updating on the render thread");
+      app->threaded_update = 0;
+    }
 
-      while (app->update != NULL && delta_time >= 1.0)
-        {
-          app->update();
-          updates++;
-          delta_time--;
-        }
+  while (!should_close(app, frame++))
+    {
+      KYU_PROFILE_BEGIN("frame");
+      if (!app->threaded_update)
+        run_updates(app, &last_time, &delta_time);
+
+      kyu_frame_bind(&app->render_arena);
+      kyu_arena_reset(&app->render_arena);
+
+      if (app->has_snapshots)
+        v = prepare_snapshot(app, delta_time);
 #else /* __KYU_PS2__ */
   qword_t *q = NULL;
+  frame_start = kyu_clock_now();
   while (1)
     {
       dma_wait_fast();
@@ -235,29 +376,70 @@ kyu_run(kyu_app *app)
                      app->fb.width, app->fb.height,
                      20, 20, 20);
 
+      kyu_frame_bind(&app->update_arena);
+      kyu_arena_reset(&app->update_arena);
+      KYU_PROFILE_BEGIN("update");
+      start = kyu_clock_now();
       if (app->update != NULL)
         app->update();
+      kyu_stats_record(KYU_STAT_UPDATE, kyu_clock_now() - start);
+      KYU_PROFILE_END();
 
+      kyu_frame_bind(&app->render_arena);
+      kyu_arena_reset(&app->render_arena);
       v = q;
 #endif
       
+      KYU_PROFILE_BEGIN("render");
+      start = kyu_clock_now();
+#ifndef __KYU_PS2__
+      kyu_gpu_frame_begin();
+#endif
       v = app->render(v);
+#ifndef __KYU_PS2__
+      kyu_gpu_frame_end();
+#endif
+      kyu_stats_record(KYU_STAT_RENDER, kyu_clock_now() - start);
+      KYU_PROFILE_END();
+
+      count_allocations(app);
 
 #ifndef __KYU_PS2__
-      /* Swap front and back buffers */
-      glfwSwapBuffers(app->window);
-      frames++;
+      /* Frame limiter, a late frame doesn't make the next ones early */
+      if (app->frame_period > 0.0 && !app->headless)
+        {
+          next_frame += app->frame_period;
+          if (kyu_clock_now() - next_frame > app->frame_period)
+            next_frame = kyu_clock_now();
+          else
+            {
+              KYU_PROFILE_BEGIN("wait");
+              start = kyu_clock_now();
+              kyu_clock_wait_until(next_frame);
+              kyu_stats_record(KYU_STAT_WAIT, kyu_clock_now() - start);
+              KYU_PROFILE_END();
+            }
+        }
+
+      /* Swap front and back buffers, offscreen the frame is finished
+         instead so that the GPU work doesn't pile up */
+      KYU_PROFILE_BEGIN("swap");
+      start = kyu_clock_now();
+      if (app->headless)
+        glFinish();
+      else
+        glfwSwapBuffers(app->window);
+      kyu_stats_record(KYU_STAT_SWAP, kyu_clock_now() - start);
+      KYU_PROFILE_END();
       
       /* Poll for and process events */
-      glfwPollEvents();
-      
-      if (glfwGetTime() - timer > 1.0)
+      if (!app->headless)
         {
-          timer++;
-          printf("\rUpdates : %d | Frames : %d", updates, frames);
-          fflush(stdout);
-          updates = frames = 0;
+          KYU_PROFILE_BEGIN("poll");
+          glfwPollEvents();
+          KYU_PROFILE_END();
         }
+      KYU_PROFILE_END();
 #else /* __KYU_PS2__ */
       q = (qword_t *)v;
       q = draw_finish(q);
@@ -265,22 +447,391 @@ kyu_run(kyu_app *app)
       draw_wait_finish();
       graph_wait_vsync();
 #endif
+
+      /* From the start of a frame to the start of the next one */
+      start = kyu_clock_now();
+      kyu_stats_record(KYU_STAT_FRAME, start - frame_start);
+      frame_start = start;
+
+      kyu_metrics_frame(app->frame_allocations);
     }
-  printf("\n");
+
+#ifndef __KYU_PS2__
+  kyu_atomic_store(&app->running, 0);
+  if (app->threaded_update)
+    kyu_thread_join(&app->update_thread);
+#endif
 
   if (app->quit != NULL)
     app->quit();
 
+  if (app->stats_file != NULL)
+    kyu_stats_dump(app->stats_file);
+  kyu_metrics_close();
+
+  kyu_job_quit();
+
+  kyu_frame_bind(NULL);
+  kyu_arena_release(&app->update_arena);
+  kyu_arena_release(&app->render_arena);
+
 #ifndef __KYU_PS2__
-  glfwTerminate();
+  if (app->has_snapshots)
+    {
+      kyu_snapshots_release(&app->snapshots);
+      kyu_free(app->snapshot);
+    }
+
+  kyu_gpu_timers_release();
+
+  if (app->headless)
+    kyu_headless_release(&app->offscreen);
+  else
+    glfwTerminate();
 #endif
 
-  free(app);
+  kyu_free(app);
   app = NULL;
+
+  kyu_log_quit();
   
   return EXIT_SUCCESS;
 }
 
+int
+kyu_set_snapshots(kyu_app *app, size_t size,
+                  void (*publish)(void *snapshot),
+                  void (*interpolate)(void *dest, const void *prev,
+                                      const void *next, double alpha))
+{
+  KYU_ASSERT(app != NULL, "Pointer to kyu_app is NULL");
+  KYU_ASSERT(publish != NULL, "No publish callback provided");
+  KYU_ASSERT(interpolate != NULL, "No interpolate callback provided");
+  if (app == NULL || publish == NULL || interpolate == NULL)
+    return -1;
+
+#ifndef __KYU_PS2__
+  if (app->has_snapshots)
+    {
+      kyu_snapshots_release(&app->snapshots);
+      kyu_free(app->snapshot);
+      app->has_snapshots = 0;
+    }
+
+  if (kyu_snapshots_init(&app->snapshots, size) != 0)
+    return -1;
+
+  app->snapshot = kyu_calloc(1, size, KYU_MEMORY_CORE);
+  KYU_ASSERT(app->snapshot != NULL, "Can't allocate memory for the render snapshot");
+  if (app->snapshot == NULL)
+    {
+      kyu_snapshots_release(&app->snapshots);
+      return -1;
+    }
+
+  app->publish       = publish;
+  app->interpolate   = interpolate;
+  app->has_snapshots = 1;
+
+  return 0;
+#else
+  (void)size;
+  KYU_LOG_WARNING("Snapshots are not available on the PS2");
+  return -1;
+#endif /* !__KYU_PS2__ */
+}
+
+int
+kyu_set_threaded_update(kyu_app *app, int enable)
+{
+  KYU_ASSERT(app != NULL, "Pointer to kyu_app is NULL");
+  if (app == NULL)
+    return -1;
+
+#ifndef __KYU_PS2__
+  KYU_ASSERT(!enable || app->has_snapshots,
+             "The threaded update needs snapshots, call kyu_set_snapshots first");
+  if (enable && !app->has_snapshots)
+    return -1;
+
+  app->threaded_update = (enable != 0);
+  return 0;
+#else
+  if (enable)
+    KYU_LOG_WARNING("The threaded update is not available on the PS2");
+  return enable ? -1 : 0;
+#endif /* !__KYU_PS2__ */
+}
+
+int
+kyu_set_frame_rate(kyu_app *app, double fps)
+{
+  KYU_ASSERT(app != NULL, "Pointer to kyu_app is NULL");
+  KYU_ASSERT(fps >= 0.0, "Negative frame rate");
+  if (app == NULL || fps < 0.0)
+    return -1;
+
+#ifndef __KYU_PS2__
+  app->frame_period = (fps > 0.0) ? 1.0 / fps : 0.0;
+  return 0;
+#else
+  KYU_LOG_WARNING("The PS2 is paced by the vertical sync");
+  return -1;
+#endif /* !__KYU_PS2__ */
+}
+
+int
+kyu_set_vsync(kyu_app *app, kyu_vsync vsync)
+{
+  KYU_ASSERT(app != NULL, "Pointer to kyu_app is NULL");
+  if (app == NULL)
+    return -1;
+
+#ifndef __KYU_PS2__
+  if (app->headless)
+    {
+      app->vsync = KYU_VSYNC_OFF;
+      return 0;
+    }
+
+  /* Adaptive vsync tears instead of waiting a whole refresh when late */
+  if (vsync == KYU_VSYNC_ADAPTIVE
+      && !glfwExtensionSupported("WGL_EXT_swap_control_tear")
+      && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+    {
+      KYU_LOG_WARNING("Adaptive vsync is not supported, using vsync");
+      vsync = KYU_VSYNC_ON;
+    }
+
+  app->vsync = vsync;
+  glfwSwapInterval((vsync == KYU_VSYNC_ADAPTIVE) ? -1 : (vsync == KYU_VSYNC_ON));
+
+  return 0;
+#else
+  (void)vsync;
+  KYU_LOG_WARNING("The PS2 is always paced by the vertical sync");
+  return -1;
+#endif /* !__KYU_PS2__ */
+}
+
+int
+kyu_set_max_updates(kyu_app *app, int max_updates)
+{
+  KYU_ASSERT(app != NULL, "Pointer to kyu_app is NULL");
+  KYU_ASSERT(max_updates > 0, "At least one update per frame is needed");
+  if (app == NULL || max_updates <= 0)
+    return -1;
+
+#ifndef __KYU_PS2__
+  app->max_updates = max_updates;
+  return 0;
+#else
+  KYU_LOG_WARNING("The PS2 runs one update per frame");
+  return -1;
+#endif /* !__KYU_PS2__ */
+}
+
+int
+kyu_set_stats_file(kyu_app *app, const char *filename)
+{
+  KYU_ASSERT(app != NULL, "Pointer to kyu_app is NULL");
+  if (app == NULL)
+    return -1;
+
+  app->stats_file = filename;
+  return 0;
+}
+
+int
+kyu_read_pixels(kyu_app *app, unsigned char *pixels)
+{
+  KYU_ASSERT(app != NULL, "Pointer to kyu_app is NULL");
+  KYU_ASSERT(pixels != NULL, "No pixel buffer provided");
+  if (app == NULL || pixels == NULL)
+    return -1;
+
+#ifndef __KYU_PS2__
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, kyu_default_framebuffer(app));
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, app->width, app->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  return 0;
+#else
+  KYU_LOG_WARNING("Can't read the PS2 framebuffer");
+  return -1;
+#endif /* !__KYU_PS2__ */
+}
+
+unsigned int
+kyu_default_framebuffer(const kyu_app *app)
+{
+  KYU_ASSERT(app != NULL, "Pointer to kyu_app is NULL");
+  if (app == NULL)
+    return 0;
+
+#ifndef __KYU_PS2__
+  return app->headless ? app->offscreen.fbo : 0;
+#else
+  return 0;
+#endif /* !__KYU_PS2__ */
+}
+
+long
+kyu_get_frame_allocations(const kyu_app *app)
+{
+  KYU_ASSERT(app != NULL, "Pointer to kyu_app is NULL");
+  if (app == NULL)
+    return -1;
+
+  return app->frame_allocations;
+}
+
+#ifndef __KYU_PS2__
+static GLFWwindow *
+create_window(int width, int height, const char *name)
+{
+  GLFWwindow* window = NULL;
+
+  glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifndef NDEBUG
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
+
+#ifdef __APPLE
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif /* __APPLE */
+  
+  window = glfwCreateWindow(width, height, name, NULL, NULL);
+  if (!window)
+    {
+      glfwTerminate();
+      ERR_EXIT("Can't create a window...");
+    }
+
+  /* Make the window's context current */
+  glfwMakeContextCurrent(window);
+  glfwSetFramebufferSizeCallback(window, resize_callback);
+  glfwSetKeyCallback(window, input_callback);
+  
+  if (gladLoadGLLoader((GLADloadproc) glfwGetProcAddress) == 0)
+    {
+      glfwTerminate();
+      ERR_EXIT("Can't initialize GLAD...");
+    }
+
+  return window;
+}
+
+static int
+should_close(kyu_app *app, long frame)
+{
+  if (app->headless)
+    return frame >= app->frames;
+
+  return glfwWindowShouldClose(app->window);
+}
+
+static void
+run_updates(kyu_app *app, double *last_time, double *delta_time)
+{
+  double now_time = kyu_clock_now();
+  double start;
+  int updates = 0;
+
+  /* Offscreen the clock is a step per frame, whatever the frame took */
+  if (app->headless)
+    {
+      kyu_deltatime = KYU_UPDATE_STEP;
+      now_time = *last_time + KYU_UPDATE_STEP;
+      *delta_time += 1.0;
+    }
+  else
+    {
+      kyu_deltatime = (now_time - *last_time);
+      *delta_time += kyu_deltatime / KYU_UPDATE_STEP;
+    }
+  *last_time = now_time;
+
+  while (app->update != NULL && *delta_time >= 1.0)
+    {
+      kyu_frame_bind(&app->update_arena);
+      kyu_arena_reset(&app->update_arena);
+      KYU_PROFILE_BEGIN("update");
+      start = kyu_clock_now();
+      app->update();
+      kyu_stats_record(KYU_STAT_UPDATE, kyu_clock_now() - start);
+      KYU_PROFILE_END();
+      *delta_time -= 1.0;
+
+      /* Timestamp of the tick this state belongs to */
+      publish_snapshot(app, now_time - *delta_time * KYU_UPDATE_STEP);
+
+      /* After a stall, drop the backlog rather than spiral */
+      if (++updates >= app->max_updates && *delta_time >= 1.0)
+        {
+          *delta_time = fmod(*delta_time, 1.0);
+          break;
+        }
+    }
+}
+
+static void
+publish_snapshot(kyu_app *app, double time)
+{
+  if (!app->has_snapshots)
+    return;
+
+  app->publish(kyu_snapshots_begin_write(&app->snapshots));
+  kyu_snapshots_end_write(&app->snapshots, time);
+}
+
+static void *
+prepare_snapshot(kyu_app *app, double alpha)
+{
+  void *prev, *next;
+  double next_time;
+
+  if (kyu_snapshots_acquire(&app->snapshots, &prev, &next, &next_time) == 0)
+    return app->snapshot;
+
+  /* The update thread has its own accumulator, the fraction comes from
+     the age of the latest snapshot */
+  if (app->threaded_update)
+    alpha = (kyu_clock_now() - next_time) / KYU_UPDATE_STEP;
+
+  alpha = MAX(0.0, MIN(alpha, 1.0));
+  app->interpolate(app->snapshot, prev, next, alpha);
+
+  kyu_snapshots_release_read(&app->snapshots);
+
+  return app->snapshot;
+}
+
+static void *
+update_thread(void *data)
+{
+  kyu_app *app = (kyu_app *)data;
+  double last_time, delta_time;
+
+  delta_time = 0.0;
+  last_time = kyu_clock_now();
+
+  /* update() may use the job system */
+  kyu_job_attach();
+  kyu_profile_thread_name("update");
+
+  while (kyu_atomic_load(&app->running))
+    {
+      run_updates(app, &last_time, &delta_time);
+      kyu_thread_sleep((1.0 - delta_time) * KYU_UPDATE_STEP);
+    }
+
+  return NULL;
+}
+#endif /* !__KYU_PS2__ */
+
 #ifndef __KYU_PS2__
 #ifndef NDEBUG
 static void
@@ -390,3 +941,24 @@ APIENTRY kyu_log_error_callback(GLenum source, GLenum type, GLuint id, GLenum se
 }
 #endif /* !NDEBUG */
 #endif /* !__KYU_PS2__ */
+
+/* Once warmed up, a frame should not touch the general heap */
+static void
+count_allocations(kyu_app *app)
+{
+  long count = kyu_memory_allocations();
+
+  app->frame_allocations = count - app->allocation_mark;
+  app->allocation_mark = count;
+
+#ifndef NDEBUG
+  if (app->warmup_frames > 0)
+    app->warmup_frames--;
+  else if (app->frame_allocations != 0 && app->warmup_frames == 0)
+    {
+      KYU_LOG_WARNING("%ld heap allocations during a steady-state frame",
+                      app->frame_allocations);
+      app->warmup_frames = -1;
+    }
+#endif
+}
@@ -0,0 +1,95 @@
+/* clock -- monotonic time and precise waits
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#if defined(__unix__) || defined(__unix) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "kyu/core/clock.h"
+#include "kyu/core/utils.h"
+#include "core/thread.h"
+
+#if defined(__KYU_WIN__)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Bounds of the spin margin, in seconds */
+#define KYU_CLOCK_MIN_MARGIN 0.0002
+#define KYU_CLOCK_MAX_MARGIN 0.02
+
+static KYU_THREAD_LOCAL double margin = 0.002;
+
+double
+kyu_clock_now(void)
+{
+#if defined(__KYU_WIN__)
+  static double period = 0.0;
+  LARGE_INTEGER counter;
+
+  if (period == 0.0)
+    {
+      LARGE_INTEGER frequency;
+
+      QueryPerformanceFrequency(&frequency);
+      period = 1.0 / (double)frequency.QuadPart;
+    }
+
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart * period;
+#elif defined(__KYU_PS2__)
+  return (double)clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+void
+kyu_clock_sleep(double seconds)
+{
+  kyu_thread_sleep(seconds);
+}
+
+void
+kyu_clock_wait_until(double deadline)
+{
+  double now, before, requested, overshoot;
+
+  now = kyu_clock_now();
+  if (deadline - now > margin)
+    {
+      before = now;
+      requested = deadline - now - margin;
+      kyu_thread_sleep(requested);
+      now = kyu_clock_now();
+
+      /* Follow the scheduler: jump up on a late wake-up, decay slowly */
+      overshoot = (now - before) - requested;
+      margin = MAX(margin * 0.95, overshoot * 1.25);
+      margin = MAX(KYU_CLOCK_MIN_MARGIN, MIN(margin, KYU_CLOCK_MAX_MARGIN));
+    }
+
+  while (now < deadline)
+    {
+      kyu_thread_yield();
+      now = kyu_clock_now();
+    }
+}
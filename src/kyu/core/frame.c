@@ -0,0 +1,217 @@
+/* frame -- per-tick linear allocator
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/core/frame.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
+#include "core/thread.h"
+
+#include <stdlib.h>
+
+#define ALIGN_UP(X) (((X) + (KYU_FRAME_ALIGN - 1)) & ~(size_t)(KYU_FRAME_ALIGN - 1))
+
+/* Heap blocks of a tick that did not fit, the link sits in the aligned
+   header before the user memory */
+#define OVERFLOW_HEADER ALIGN_UP(sizeof(void *))
+
+static KYU_THREAD_LOCAL kyu_arena *bound = NULL;
+
+static void free_overflow(kyu_arena *arena, int half);
+
+int
+kyu_arena_init(kyu_arena *arena, size_t size)
+{
+  int i;
+
+  KYU_ASSERT(arena != NULL, "No arena provided");
+  if (arena == NULL)
+    return -1;
+
+  size = ALIGN_UP(MAX(size, (size_t)KYU_FRAME_ALIGN));
+  for (i = 0; i < 2; ++i)
+    {
+      arena->data[i]     = kyu_malloc(size, KYU_MEMORY_FRAME);
+      arena->size[i]     = size;
+      arena->peak[i]     = 0;
+      arena->overflow[i] = NULL;
+
+      KYU_ASSERT(arena->data[i] != NULL, "Can't allocate memory for the arena");
+      if (arena->data[i] == NULL)
+        {
+          kyu_free(arena->data[0]);
+          arena->data[0] = NULL;
+          return -1;
+        }
+    }
+
+  arena->used    = 0;
+  arena->current = 0;
+
+  return 0;
+}
+
+void
+kyu_arena_release(kyu_arena *arena)
+{
+  int i;
+
+  KYU_ASSERT(arena != NULL, "No arena provided");
+  if (arena == NULL)
+    return;
+
+  for (i = 0; i < 2; ++i)
+    {
+      free_overflow(arena, i);
+      kyu_free(arena->data[i]);
+      arena->data[i] = NULL;
+      arena->size[i] = 0;
+    }
+
+  if (bound == arena)
+    bound = NULL;
+}
+
+void
+kyu_arena_reset(kyu_arena *arena)
+{
+  int half;
+
+  KYU_ASSERT(arena != NULL, "No arena provided");
+  if (arena == NULL)
+    return;
+
+  half = 1 - arena->current;
+  free_overflow(arena, half);
+
+  /* Grow once so that the next ticks of the same size fit */
+  if (arena->peak[half] > arena->size[half])
+    {
+      size_t size = ALIGN_UP(arena->peak[half] + arena->peak[half] / 2);
+      unsigned char *data = kyu_malloc(size, KYU_MEMORY_FRAME);
+
+      if (data != NULL)
+        {
+          KYU_LOG_WARNING("Frame arena grown from %lu to %lu bytes",
+                          (unsigned long)arena->size[half], (unsigned long)size);
+          kyu_free(arena->data[half]);
+          arena->data[half] = data;
+          arena->size[half] = size;
+        }
+    }
+
+  arena->peak[half] = 0;
+  arena->current = half;
+  arena->used = 0;
+}
+
+void *
+kyu_arena_alloc(kyu_arena *arena, size_t size)
+{
+  int half;
+  size_t offset;
+  unsigned char *block;
+
+  KYU_ASSERT(arena != NULL, "No arena provided");
+  if (arena == NULL)
+    return NULL;
+
+  half = arena->current;
+  offset = ALIGN_UP(arena->used);
+  arena->used = offset + size;
+  arena->peak[half] = MAX(arena->peak[half], arena->used);
+
+  if (arena->used <= arena->size[half])
+    return arena->data[half] + offset;
+
+  block = kyu_malloc(OVERFLOW_HEADER + size, KYU_MEMORY_FRAME);
+  KYU_ASSERT(block != NULL, "Can't allocate memory for the arena overflow");
+  if (block == NULL)
+    return NULL;
+
+  *(void **)block = arena->overflow[half];
+  arena->overflow[half] = block;
+
+  return block + OVERFLOW_HEADER;
+}
+
+int
+kyu_arena_owns(kyu_arena *arena, const void *ptr)
+{
+  const unsigned char *p = (const unsigned char *)ptr;
+  unsigned char *block;
+  int i;
+
+  if (arena == NULL || ptr == NULL)
+    return 0;
+
+  for (i = 0; i < 2; ++i)
+    {
+      if (arena->data[i] != NULL
+          && p >= arena->data[i] && p < arena->data[i] + arena->size[i])
+        return 1;
+
+      for (block = arena->overflow[i]; block != NULL; block = *(void **)block)
+        {
+          if (p == block + OVERFLOW_HEADER)
+            return 1;
+        }
+    }
+
+  return 0;
+}
+
+void
+kyu_frame_bind(kyu_arena *arena)
+{
+  bound = arena;
+}
+
+kyu_arena *
+kyu_frame_arena(void)
+{
+  return bound;
+}
+
+void *
+kyu_frame_alloc(size_t size)
+{
+  KYU_ASSERT(bound != NULL, "No frame arena bound to this thread");
+  if (bound == NULL)
+    return NULL;
+
+  return kyu_arena_alloc(bound, size);
+}
+
+int
+kyu_frame_owns(const void *ptr)
+{
+  return kyu_arena_owns(bound, ptr);
+}
+
+static void
+free_overflow(kyu_arena *arena, int half)
+{
+  void *block, *next;
+
+  for (block = arena->overflow[half]; block != NULL; block = next)
+    {
+      next = *(void **)block;
+      kyu_free(block);
+    }
+
+  arena->overflow[half] = NULL;
+}
@@ -0,0 +1,248 @@
+/* headless -- offscreen OpenGL context without a display
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "core/headless.h"
+#include "kyu/core/utils.h"
+
+#include <stddef.h>
+
+#ifdef KYU_HAS_EGL
+#include "kyu/graphics/gl.h"
+
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <string.h>
+
+/* Tried in order, the first one the driver accepts is kept */
+static const EGLint versions[][2] = { { 4, 4 }, { 3, 3 } };
+
+static int has_extension(const char *extensions, const char *name);
+static EGLDisplay get_display(int *surfaceless);
+static int create_target(kyu_headless *headless, int width, int height);
+
+int
+kyu_headless_init(kyu_headless *headless, int width, int height)
+{
+  EGLDisplay display;
+  EGLContext context = EGL_NO_CONTEXT;
+  EGLSurface surface = EGL_NO_SURFACE;
+  EGLConfig config;
+  EGLint count = 0;
+  size_t i;
+  int surfaceless;
+
+  EGLint config_attribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE
+  };
+  EGLint context_attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 0,
+    EGL_CONTEXT_MINOR_VERSION, 0,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifndef NDEBUG
+    EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+    EGL_NONE
+  };
+  const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+
+  KYU_ASSERT(headless != NULL, "No headless context provided");
+  if (headless == NULL)
+    return -1;
+
+  memset(headless, 0, sizeof(kyu_headless));
+
+  display = get_display(&surfaceless);
+  if (display == EGL_NO_DISPLAY || eglInitialize(display, NULL, NULL) != EGL_TRUE)
+    {
+      KYU_LOG_ERROR("Can't initialize an EGL display");
+      return -1;
+    }
+
+  /* Without a surface the context renders to our framebuffer only */
+  surfaceless = surfaceless
+    || has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+  if (surfaceless)
+    config_attribs[1] = 0;
+
+  if (eglBindAPI(EGL_OPENGL_API) != EGL_TRUE
+      || eglChooseConfig(display, config_attribs, &config, 1, &count) != EGL_TRUE
+      || count == 0)
+    {
+      KYU_LOG_ERROR("No EGL config for desktop OpenGL");
+      eglTerminate(display);
+      return -1;
+    }
+
+  for (i = 0; i < sizeof(versions) / sizeof(versions[0]); ++i)
+    {
+      context_attribs[1] = versions[i][0];
+      context_attribs[3] = versions[i][1];
+      context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+      if (context != EGL_NO_CONTEXT)
+        break;
+    }
+
+  if (context == EGL_NO_CONTEXT)
+    {
+      KYU_LOG_ERROR("Can't create an OpenGL 3.3 core context with EGL");
+      eglTerminate(display);
+      return -1;
+    }
+
+  if (!surfaceless)
+    surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+
+  if ((!surfaceless && surface == EGL_NO_SURFACE)
+      || eglMakeCurrent(display, surface, surface, context) != EGL_TRUE)
+    {
+      KYU_LOG_ERROR("Can't make the EGL context current");
+      if (surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, surface);
+      eglDestroyContext(display, context);
+      eglTerminate(display);
+      return -1;
+    }
+
+  headless->display = display;
+  headless->context = context;
+  headless->surface = surface;
+
+  if (gladLoadGLLoader((GLADloadproc)eglGetProcAddress) == 0
+      || create_target(headless, width, height) != 0)
+    {
+      KYU_LOG_ERROR("Can't set up OpenGL on the EGL context");
+      kyu_headless_release(headless);
+      return -1;
+    }
+
+  return 0;
+}
+
+void
+kyu_headless_release(kyu_headless *headless)
+{
+  if (headless == NULL || headless->display == NULL)
+    return;
+
+  if (headless->fbo != 0)
+    {
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glDeleteFramebuffers(1, &headless->fbo);
+      glDeleteRenderbuffers(1, &headless->color);
+      glDeleteRenderbuffers(1, &headless->depth);
+    }
+
+  eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (headless->surface != NULL)
+    eglDestroySurface(headless->display, headless->surface);
+  eglDestroyContext(headless->display, headless->context);
+  eglTerminate(headless->display);
+
+  memset(headless, 0, sizeof(kyu_headless));
+}
+
+static int
+has_extension(const char *extensions, const char *name)
+{
+  size_t length = strlen(name);
+  const char *p = extensions;
+
+  while (p != NULL && (p = strstr(p, name)) != NULL)
+    {
+      if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+        return 1;
+      p += length;
+    }
+
+  return 0;
+}
+
+/* Mesa's surfaceless platform needs neither X11 nor a GPU, llvmpipe is
+   enough. Other drivers get the default display. */
+static EGLDisplay
+get_display(int *surfaceless)
+{
+  const char *client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+
+  *surfaceless = 0;
+  if (has_extension(client, "EGL_MESA_platform_surfaceless")
+      && has_extension(client, "EGL_EXT_platform_base"))
+    {
+      get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress("eglGetPlatformDisplayEXT");
+      if (get_platform_display != NULL)
+        {
+          *surfaceless = 1;
+          return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                      EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static int
+create_target(kyu_headless *headless, int width, int height)
+{
+  glGenFramebuffers(1, &headless->fbo);
+  glGenRenderbuffers(1, &headless->color);
+  glGenRenderbuffers(1, &headless->depth);
+
+  glBindRenderbuffer(GL_RENDERBUFFER, headless->color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, headless->depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, headless->fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, headless->color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER, headless->depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    return -1;
+
+  glViewport(0, 0, width, height);
+
+  return 0;
+}
+
+#else /* !KYU_HAS_EGL */
+
+int
+kyu_headless_init(kyu_headless *headless, int width, int height)
+{
+  (void)headless;
+  (void)width;
+  (void)height;
+  KYU_LOG_ERROR("kyu was built without EGL, the headless mode is not available");
+  return -1;
+}
+
+void
+kyu_headless_release(kyu_headless *headless)
+{
+  (void)headless;
+}
+
+#endif /* KYU_HAS_EGL */
@@ -0,0 +1,39 @@
+/* headless -- offscreen OpenGL context without a display
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_HEADLESS_H
+#define KYU_HEADLESS_H
+
+/* EGL handles are kept opaque so that only headless.c needs its headers.
+   The framebuffer object stays bound for the whole run. */
+typedef struct {
+  void *display;
+  void *context;
+  void *surface;
+
+  unsigned int fbo;
+  unsigned int color;
+  unsigned int depth;
+} kyu_headless;
+
+/* Makes an OpenGL 3.3+ core context current on the calling thread, with
+   GLAD loaded and a width x height RGBA8 / depth-stencil target. Fails
+   when kyu was built without EGL. */
+int  kyu_headless_init(kyu_headless *headless, int width, int height);
+void kyu_headless_release(kyu_headless *headless);
+
+#endif /* KYU_HEADLESS_H */
@@ -0,0 +1,524 @@
+/* job -- work-stealing job system
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/core/job.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
+#include "kyu/core/profile.h"
+#include "core/thread.h"
+
+#include <stdlib.h>
+
+#define KYU_JOB_MASK (KYU_JOB_MAX - 1)
+
+/* Jobs that can wait on a single job */
+#define KYU_JOB_CONTINUATIONS 4
+
+/* Yields before an idle worker goes to sleep */
+#define KYU_JOB_SPINS 64
+
+struct kyu_job {
+  void (*func)(void *data);
+  void (*range)(int begin, int end, void *data);
+  void *data;
+  int begin;
+  int end;
+
+  kyu_job *parent;
+  kyu_atomic unfinished;   /* itself and its children */
+  kyu_atomic dependencies; /* unfinished dependencies, +1 until run */
+
+  kyu_job *continuations[KYU_JOB_CONTINUATIONS];
+  int nb_continuations;
+};
+
+/* Chase-Lev deque: the owner pushes and pops at the bottom, the other
+   threads steal at the top */
+typedef struct {
+  kyu_atomic top;
+  kyu_atomic bottom;
+  kyu_job *volatile *deque;
+
+  kyu_job *jobs;
+  unsigned int allocated;
+  unsigned int seed;
+
+  kyu_thread thread;
+  int started;
+
+  char pad[64];
+} worker;
+
+/* Slot 0 is the thread that called kyu_job_init, the workers follow and
+   the attached threads take the last KYU_JOB_ATTACHED slots */
+static struct {
+  worker *workers;
+  int nb_workers;
+  int nb_slots;
+  kyu_atomic nb_threads;
+
+  kyu_atomic running;
+  kyu_atomic queued;
+  kyu_atomic sleeping;
+  kyu_mutex mutex;
+  kyu_cond cond;
+} scheduler;
+
+static KYU_THREAD_LOCAL int current = -1;
+
+static void     *worker_main(void *data);
+static kyu_job  *alloc_job(kyu_job *parent);
+static void      push(worker *w, kyu_job *job);
+static kyu_job  *pop(worker *w);
+static kyu_job  *steal(worker *w);
+static kyu_job  *get_job(int self);
+static void      execute(kyu_job *job);
+static void      finish(kyu_job *job);
+static void      release_workers(void);
+
+int
+kyu_job_init(int nb_workers)
+{
+  int i;
+
+  if (scheduler.workers != NULL)
+    return 0;
+
+#ifdef KYU_NO_THREADS
+  nb_workers = 0;
+#else
+  if (nb_workers < 0)
+    nb_workers = kyu_thread_hardware_count() - 1;
+#endif
+
+  scheduler.nb_workers = nb_workers;
+  scheduler.nb_slots   = 1 + nb_workers + KYU_JOB_ATTACHED;
+  scheduler.workers    = kyu_calloc(scheduler.nb_slots, sizeof(worker), KYU_MEMORY_JOB);
+  KYU_ASSERT(scheduler.workers != NULL, "Can't allocate memory for the job workers");
+  if (scheduler.workers == NULL)
+    return -1;
+
+  for (i = 0; i < scheduler.nb_slots; ++i)
+    {
+      worker *w = &scheduler.workers[i];
+
+      w->deque = kyu_calloc(KYU_JOB_MAX, sizeof(kyu_job *), KYU_MEMORY_JOB);
+      w->jobs  = kyu_calloc(KYU_JOB_MAX, sizeof(kyu_job), KYU_MEMORY_JOB);
+      w->seed  = (unsigned int)i * 2654435761u + 1;
+
+      KYU_ASSERT(w->deque != NULL && w->jobs != NULL,
+                 "Can't allocate memory for the job queues");
+      if (w->deque == NULL || w->jobs == NULL)
+        {
+          release_workers();
+          return -1;
+        }
+    }
+
+  kyu_mutex_init(&scheduler.mutex);
+  kyu_cond_init(&scheduler.cond);
+  scheduler.running    = 1;
+  scheduler.queued     = 0;
+  scheduler.sleeping   = 0;
+  scheduler.nb_threads = 1 + nb_workers;
+  current = 0;
+
+  for (i = 1; i <= nb_workers; ++i)
+    {
+      worker *w = &scheduler.workers[i];
+
+      w->started = (kyu_thread_create(&w->thread, worker_main, w) == 0);
+      if (!w->started)
+        KYU_LOG_WARNING("Can't create job worker %d", i);
+    }
+
+  return 0;
+}
+
+void
+kyu_job_quit(void)
+{
+  int i;
+
+  if (scheduler.workers == NULL)
+    return;
+
+  kyu_mutex_lock(&scheduler.mutex);
+  kyu_atomic_store(&scheduler.running, 0);
+  kyu_cond_broadcast(&scheduler.cond);
+  kyu_mutex_unlock(&scheduler.mutex);
+
+  for (i = 1; i <= scheduler.nb_workers; ++i)
+    {
+      if (scheduler.workers[i].started)
+        kyu_thread_join(&scheduler.workers[i].thread);
+    }
+
+  kyu_cond_destroy(&scheduler.cond);
+  kyu_mutex_destroy(&scheduler.mutex);
+  release_workers();
+  current = -1;
+}
+
+int
+kyu_job_workers(void)
+{
+  return (scheduler.workers != NULL) ? scheduler.nb_workers : 0;
+}
+
+int
+kyu_job_attach(void)
+{
+  long slot;
+
+  KYU_ASSERT(scheduler.workers != NULL, "The job system is not initialized");
+  if (scheduler.workers == NULL)
+    return -1;
+
+  if (current >= 0)
+    return 0;
+
+  slot = kyu_atomic_add(&scheduler.nb_threads, 1);
+  if (slot >= scheduler.nb_slots)
+    {
+      kyu_atomic_add(&scheduler.nb_threads, -1);
+      KYU_LOG_WARNING("No job slot left, at most %d threads can be attached",
+                      KYU_JOB_ATTACHED);
+      return -1;
+    }
+
+  current = (int)slot;
+
+  return 0;
+}
+
+kyu_job *
+kyu_job_create(void (*func)(void *data), void *data, kyu_job *parent)
+{
+  kyu_job *job;
+
+  KYU_ASSERT(current >= 0, "Jobs can only be created by the job threads");
+  if (current < 0)
+    return NULL;
+
+  job = alloc_job(parent);
+  job->func = func;
+  job->data = data;
+
+  return job;
+}
+
+void
+kyu_job_depend(kyu_job *job, kyu_job *dependency)
+{
+  KYU_ASSERT(job != NULL && dependency != NULL, "No job provided");
+  KYU_ASSERT(dependency->nb_continuations < KYU_JOB_CONTINUATIONS,
+             "Too many jobs depend on the same job");
+  if (job == NULL || dependency == NULL
+      || dependency->nb_continuations >= KYU_JOB_CONTINUATIONS)
+    return;
+
+  kyu_atomic_add(&job->dependencies, 1);
+  dependency->continuations[dependency->nb_continuations++] = job;
+}
+
+void
+kyu_job_run(kyu_job *job)
+{
+  KYU_ASSERT(job != NULL, "No job provided");
+  KYU_ASSERT(current >= 0, "Jobs can only be run by the job threads");
+  if (job == NULL || current < 0)
+    return;
+
+  /* Queued once its dependencies are done */
+  if (kyu_atomic_add(&job->dependencies, -1) == 1)
+    push(&scheduler.workers[current], job);
+}
+
+void
+kyu_job_wait(kyu_job *job)
+{
+  KYU_ASSERT(job != NULL, "No job provided");
+  KYU_ASSERT(current >= 0, "Jobs can only be waited on by the job threads");
+  if (job == NULL || current < 0)
+    return;
+
+  while (!kyu_job_done(job))
+    {
+      kyu_job *next = get_job(current);
+
+      if (next != NULL)
+        execute(next);
+      else
+        kyu_thread_yield();
+    }
+}
+
+int
+kyu_job_done(kyu_job *job)
+{
+  return kyu_atomic_load(&job->unfinished) == 0;
+}
+
+void
+kyu_job_parallel_for(int count, int grain,
+                     void (*func)(int begin, int end, void *data),
+                     void *data)
+{
+  kyu_job *root, *job;
+  int begin;
+
+  KYU_ASSERT(func != NULL, "No function provided");
+  if (func == NULL || count <= 0)
+    return;
+
+  /* A few ranges per thread so that stealing can balance the load, and
+     never more than half the job ring */
+  if (grain <= 0)
+    grain = count / ((kyu_job_workers() + 1) * 4);
+  grain = MAX(grain, (count + KYU_JOB_MAX / 2 - 1) / (KYU_JOB_MAX / 2));
+  grain = MAX(grain, 1);
+
+  if (scheduler.workers == NULL || current < 0 || grain >= count)
+    {
+      func(0, count, data);
+      return;
+    }
+
+  root = alloc_job(NULL);
+  for (begin = 0; begin < count; begin += grain)
+    {
+      job = alloc_job(root);
+      job->range = func;
+      job->data  = data;
+      job->begin = begin;
+      job->end   = MIN(begin + grain, count);
+      kyu_job_run(job);
+    }
+
+  kyu_job_run(root);
+  kyu_job_wait(root);
+}
+
+static void *
+worker_main(void *data)
+{
+  worker *w = (worker *)data;
+  kyu_job *job;
+  int spins = 0;
+
+  current = (int)(w - scheduler.workers);
+  kyu_profile_thread_name("worker");
+
+  while (kyu_atomic_load(&scheduler.running))
+    {
+      job = get_job(current);
+      if (job != NULL)
+        {
+          execute(job);
+          spins = 0;
+          continue;
+        }
+
+      if (++spins < KYU_JOB_SPINS)
+        {
+          kyu_thread_yield();
+          continue;
+        }
+
+      /* push() only signals when someone sleeps, so sleeping must be
+         raised before queued is checked */
+      spins = 0;
+      kyu_mutex_lock(&scheduler.mutex);
+      kyu_atomic_add(&scheduler.sleeping, 1);
+      while (kyu_atomic_load(&scheduler.queued) <= 0
+             && kyu_atomic_load(&scheduler.running))
+        kyu_cond_wait(&scheduler.cond, &scheduler.mutex);
+      kyu_atomic_add(&scheduler.sleeping, -1);
+      kyu_mutex_unlock(&scheduler.mutex);
+    }
+
+  return NULL;
+}
+
+static kyu_job *
+alloc_job(kyu_job *parent)
+{
+  worker *w = &scheduler.workers[current];
+  kyu_job *job = &w->jobs[w->allocated++ & KYU_JOB_MASK];
+
+  KYU_ASSERT(kyu_atomic_load(&job->unfinished) == 0,
+             "More than KYU_JOB_MAX unfinished jobs on this thread");
+
+  job->func  = NULL;
+  job->range = NULL;
+  job->data  = NULL;
+  job->begin = 0;
+  job->end   = 0;
+
+  job->parent           = parent;
+  job->unfinished       = 1;
+  job->dependencies     = 1;
+  job->nb_continuations = 0;
+
+  if (parent != NULL)
+    kyu_atomic_add(&parent->unfinished, 1);
+
+  return job;
+}
+
+static void
+push(worker *w, kyu_job *job)
+{
+  long b = kyu_atomic_load(&w->bottom);
+
+  KYU_ASSERT(b - kyu_atomic_load(&w->top) < KYU_JOB_MAX, "Job queue is full");
+
+  kyu_atomic_add(&scheduler.queued, 1);
+  w->deque[b & KYU_JOB_MASK] = job;
+  kyu_atomic_store(&w->bottom, b + 1);
+
+  if (kyu_atomic_load(&scheduler.sleeping) > 0)
+    {
+      kyu_mutex_lock(&scheduler.mutex);
+      kyu_cond_signal(&scheduler.cond);
+      kyu_mutex_unlock(&scheduler.mutex);
+    }
+}
+
+static kyu_job *
+pop(worker *w)
+{
+  kyu_job *job;
+  long b, t;
+
+  b = kyu_atomic_load(&w->bottom) - 1;
+  kyu_atomic_store(&w->bottom, b);
+  t = kyu_atomic_load(&w->top);
+
+  if (t > b)
+    {
+      kyu_atomic_store(&w->bottom, b + 1);
+      return NULL;
+    }
+
+  job = w->deque[b & KYU_JOB_MASK];
+  if (t == b)
+    {
+      /* Last job, race the thieves for it */
+      if (!kyu_atomic_cas(&w->top, t, t + 1))
+        job = NULL;
+      kyu_atomic_store(&w->bottom, b + 1);
+    }
+
+  if (job != NULL)
+    kyu_atomic_add(&scheduler.queued, -1);
+
+  return job;
+}
+
+static kyu_job *
+steal(worker *w)
+{
+  kyu_job *job;
+  long t, b;
+
+  t = kyu_atomic_load(&w->top);
+  b = kyu_atomic_load(&w->bottom);
+  if (t >= b)
+    return NULL;
+
+  job = w->deque[t & KYU_JOB_MASK];
+  if (!kyu_atomic_cas(&w->top, t, t + 1))
+    return NULL;
+
+  kyu_atomic_add(&scheduler.queued, -1);
+
+  return job;
+}
+
+static kyu_job *
+get_job(int self)
+{
+  worker *w = &scheduler.workers[self];
+  kyu_job *job;
+  int i, n, victim;
+
+  job = pop(w);
+  if (job != NULL)
+    return job;
+
+  /* Random first victim so the thieves don't all hit the same deque */
+  n = (int)kyu_atomic_load(&scheduler.nb_threads);
+  w->seed ^= w->seed << 13;
+  w->seed ^= w->seed >> 17;
+  w->seed ^= w->seed << 5;
+  victim = (int)(w->seed % (unsigned int)n);
+
+  for (i = 0; i < n; ++i, victim = (victim + 1) % n)
+    {
+      if (victim == self)
+        continue;
+
+      job = steal(&scheduler.workers[victim]);
+      if (job != NULL)
+        return job;
+    }
+
+  return NULL;
+}
+
+static void
+execute(kyu_job *job)
+{
+  if (job->range != NULL)
+    job->range(job->begin, job->end, job->data);
+  else if (job->func != NULL)
+    job->func(job->data);
+
+  finish(job);
+}
+
+static void
+finish(kyu_job *job)
+{
+  int i;
+
+  if (kyu_atomic_add(&job->unfinished, -1) != 1)
+    return;
+
+  for (i = 0; i < job->nb_continuations; ++i)
+    kyu_job_run(job->continuations[i]);
+
+  if (job->parent != NULL)
+    finish(job->parent);
+}
+
+static void
+release_workers(void)
+{
+  int i;
+
+  for (i = 0; i < scheduler.nb_slots; ++i)
+    {
+      kyu_free((void *)scheduler.workers[i].deque);
+      kyu_free(scheduler.workers[i].jobs);
+    }
+
+  kyu_free(scheduler.workers);
+  scheduler.workers = NULL;
+}
@@ -0,0 +1,257 @@
+/* memory -- allocation hooks and per-subsystem statistics
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/core/memory.h"
+#include "kyu/core/utils.h"
+#include "core/thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Each block starts with its size and tag, the header keeps the 16-byte
+   alignment of the allocator */
+typedef struct {
+  size_t size;
+  unsigned short tag;
+  unsigned short tracked;
+} memory_header;
+
+#define HEADER_SIZE ((sizeof(memory_header) + 15) & ~(size_t)15)
+#define HEADER(PTR) ((memory_header *)((unsigned char *)(PTR) - HEADER_SIZE))
+
+typedef struct {
+  kyu_atomic live_bytes;
+  kyu_atomic peak_bytes;
+  kyu_atomic live_allocations;
+  kyu_atomic allocations;
+} memory_counters;
+
+static void *libc_malloc(size_t size, kyu_memory_tag tag, void *user);
+static void *libc_realloc(void *ptr, size_t size, kyu_memory_tag tag, void *user);
+static void  libc_free(void *ptr, kyu_memory_tag tag, void *user);
+static void  track(memory_header *header, long sign);
+
+static const kyu_allocator libc_allocator = {
+  libc_malloc, libc_realloc, libc_free, NULL
+};
+
+static const char *tag_names[KYU_MEMORY_TAGS] = {
+  "core", "job", "frame", "profile", "math", "mesh", "graphics"
+};
+
+static kyu_allocator allocator = { libc_malloc, libc_realloc, libc_free, NULL };
+static memory_counters counters[KYU_MEMORY_TAGS];
+static kyu_atomic allocations = 0;
+static kyu_atomic tracking = 0;
+
+void
+kyu_set_allocator(const kyu_allocator *new_allocator)
+{
+  KYU_ASSERT(kyu_atomic_load(&allocations) == 0,
+             "The allocator must be set before the first allocation");
+
+  allocator = (new_allocator != NULL) ? *new_allocator : libc_allocator;
+}
+
+void *
+kyu_malloc(size_t size, kyu_memory_tag tag)
+{
+  memory_header *header;
+
+  KYU_ASSERT(tag < KYU_MEMORY_TAGS, "Bad memory tag");
+
+  /* The header would wrap the size around to a tiny block */
+  if (size > (size_t)-1 - HEADER_SIZE)
+    return NULL;
+
+  header = allocator.malloc(HEADER_SIZE + size, tag, allocator.user);
+  if (header == NULL)
+    return NULL;
+
+  header->size = size;
+  header->tag = (unsigned short)tag;
+  header->tracked = (unsigned short)kyu_atomic_load(&tracking);
+
+  kyu_atomic_add(&allocations, 1);
+  track(header, 1);
+
+  return (unsigned char *)header + HEADER_SIZE;
+}
+
+void *
+kyu_calloc(size_t count, size_t size, kyu_memory_tag tag)
+{
+  void *ptr;
+
+  if (size != 0 && count > ((size_t)-1 - HEADER_SIZE) / size)
+    return NULL;
+
+  ptr = kyu_malloc(count * size, tag);
+  if (ptr != NULL)
+    memset(ptr, 0, count * size);
+
+  return ptr;
+}
+
+void *
+kyu_realloc(void *ptr, size_t size, kyu_memory_tag tag)
+{
+  memory_header *header, old;
+
+  if (ptr == NULL)
+    return kyu_malloc(size, tag);
+
+  if (size == 0)
+    {
+      kyu_free(ptr);
+      return NULL;
+    }
+
+  if (size > (size_t)-1 - HEADER_SIZE)
+    return NULL;
+
+  old = *HEADER(ptr);
+  header = allocator.realloc(HEADER(ptr), HEADER_SIZE + size,
+                             (kyu_memory_tag)old.tag, allocator.user);
+  if (header == NULL)
+    return NULL;
+
+  track(&old, -1);
+  header->size = size;
+  kyu_atomic_add(&allocations, 1);
+  track(header, 1);
+
+  return (unsigned char *)header + HEADER_SIZE;
+}
+
+void
+kyu_free(void *ptr)
+{
+  memory_header *header;
+
+  if (ptr == NULL)
+    return;
+
+  header = HEADER(ptr);
+  track(header, -1);
+  allocator.free(header, (kyu_memory_tag)header->tag, allocator.user);
+}
+
+void
+kyu_memory_tracking(int enable)
+{
+  kyu_atomic_store(&tracking, enable != 0);
+}
+
+void
+kyu_memory_stats_get(kyu_memory_tag tag, kyu_memory_stats *stats)
+{
+  int i, first, last;
+
+  KYU_ASSERT(stats != NULL, "No stats provided");
+  if (stats == NULL)
+    return;
+
+  /* KYU_MEMORY_TAGS sums every subsystem, the peaks included */
+  first = (tag < KYU_MEMORY_TAGS) ? (int)tag : 0;
+  last  = (tag < KYU_MEMORY_TAGS) ? (int)tag : KYU_MEMORY_TAGS - 1;
+
+  memset(stats, 0, sizeof(kyu_memory_stats));
+  for (i = first; i <= last; ++i)
+    {
+      stats->live_bytes       += kyu_atomic_load(&counters[i].live_bytes);
+      stats->peak_bytes       += kyu_atomic_load(&counters[i].peak_bytes);
+      stats->live_allocations += kyu_atomic_load(&counters[i].live_allocations);
+      stats->allocations      += kyu_atomic_load(&counters[i].allocations);
+    }
+}
+
+long
+kyu_memory_allocations(void)
+{
+  return kyu_atomic_load(&allocations);
+}
+
+const char *
+kyu_memory_tag_name(kyu_memory_tag tag)
+{
+  return (tag < KYU_MEMORY_TAGS) ? tag_names[tag] : "all";
+}
+
+void
+kyu_memory_fprint(FILE *stream)
+{
+  kyu_memory_stats stats;
+  int i;
+
+  fprintf(stream, "%-10s %12s %12s %10s %12s\n",
+          "subsystem", "live bytes", "peak bytes", "live", "allocations");
+  for (i = 0; i <= KYU_MEMORY_TAGS; ++i)
+    {
+      kyu_memory_stats_get((kyu_memory_tag)i, &stats);
+      fprintf(stream, "%-10s %12ld %12ld %10ld %12ld\n",
+              kyu_memory_tag_name((kyu_memory_tag)i), stats.live_bytes,
+              stats.peak_bytes, stats.live_allocations, stats.allocations);
+    }
+}
+
+static void
+track(memory_header *header, long sign)
+{
+  memory_counters *c;
+  long live, peak;
+
+  if (!header->tracked || header->tag >= KYU_MEMORY_TAGS)
+    return;
+
+  c = &counters[header->tag];
+  live = kyu_atomic_add(&c->live_bytes, sign * (long)header->size)
+    + sign * (long)header->size;
+  kyu_atomic_add(&c->live_allocations, sign);
+  if (sign < 0)
+    return;
+
+  kyu_atomic_add(&c->allocations, 1);
+
+  peak = kyu_atomic_load(&c->peak_bytes);
+  while (live > peak && !kyu_atomic_cas(&c->peak_bytes, peak, live))
+    peak = kyu_atomic_load(&c->peak_bytes);
+}
+
+static void *
+libc_malloc(size_t size, kyu_memory_tag tag, void *user)
+{
+  (void)tag;
+  (void)user;
+  return malloc(size);
+}
+
+static void *
+libc_realloc(void *ptr, size_t size, kyu_memory_tag tag, void *user)
+{
+  (void)tag;
+  (void)user;
+  return realloc(ptr, size);
+}
+
+static void
+libc_free(void *ptr, kyu_memory_tag tag, void *user)
+{
+  (void)tag;
+  (void)user;
+  free(ptr);
+}
@@ -0,0 +1,303 @@
+/* metrics -- live counters in shared memory
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#if defined(__unix__) || defined(__unix) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "kyu/core/metrics.h"
+#include "kyu/core/clock.h"
+#include "kyu/core/utils.h"
+#include "core/thread.h"
+
+#include <string.h>
+
+#if defined(__KYU_WIN__)
+#include <windows.h>
+#elif !defined(__KYU_PS2__)
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* A reader gives up after that many torn copies */
+#define KYU_METRICS_RETRIES 1000
+
+static kyu_metrics_block *block = NULL;
+static char block_name[256];
+#if defined(__KYU_WIN__)
+static HANDLE mapping = NULL;
+#endif
+
+static long frame = 0;
+static long draw_calls = 0;
+static long triangles = 0;
+
+static kyu_metrics_block *map_block(const char *name, int create);
+static void unmap_block(kyu_metrics_block *mapped);
+#if !defined(__KYU_WIN__) && !defined(__KYU_PS2__)
+static int stale_block(const char *name);
+#endif
+
+int
+kyu_metrics_open(const char *name)
+{
+  KYU_ASSERT(name != NULL, "No metrics name provided");
+  if (name == NULL)
+    return -1;
+
+  if (block != NULL)
+    kyu_metrics_close();
+
+  block = map_block(name, 1);
+  if (block == NULL)
+    {
+      KYU_LOG_WARNING("Can't create the metrics block '%s'", name);
+      return -1;
+    }
+
+  strncpy(block_name, name, sizeof(block_name) - 1);
+  block_name[sizeof(block_name) - 1] = '\0';
+
+  memset(block, 0, sizeof(kyu_metrics_block));
+  block->version = KYU_METRICS_VERSION;
+#if defined(__KYU_WIN__)
+  block->pid = (long)GetCurrentProcessId();
+#elif !defined(__KYU_PS2__)
+  block->pid = (long)getpid();
+#else
+  block->pid = 0;
+#endif
+
+  /* Readers check the magic last */
+  kyu_atomic_fence();
+  block->magic = KYU_METRICS_MAGIC;
+
+  kyu_memory_tracking(1);
+
+  return 0;
+}
+
+void
+kyu_metrics_close(void)
+{
+  if (block == NULL)
+    return;
+
+  unmap_block(block);
+#if !defined(__KYU_WIN__) && !defined(__KYU_PS2__)
+  shm_unlink(block_name);
+#endif
+  block = NULL;
+}
+
+void
+kyu_metrics_draw(long triangles_submitted)
+{
+  draw_calls++;
+  triangles += triangles_submitted;
+}
+
+void
+kyu_metrics_frame(long allocations)
+{
+  kyu_stats_summary summary;
+  int i;
+
+  frame++;
+  if (block != NULL)
+    {
+      kyu_atomic_add((kyu_atomic *)&block->sequence, 1);
+      kyu_atomic_fence();
+
+      block->frame = frame;
+      block->time  = kyu_clock_now();
+      for (i = 0; i < KYU_STATS; ++i)
+        {
+          kyu_stats_get((kyu_stat)i, &summary);
+          block->times[i].p50 = summary.p50 * 1e3;
+          block->times[i].p95 = summary.p95 * 1e3;
+          block->times[i].p99 = summary.p99 * 1e3;
+          block->times[i].max = summary.max * 1e3;
+        }
+
+      block->draw_calls  = draw_calls;
+      block->triangles   = triangles;
+      block->allocations = allocations;
+      for (i = 0; i <= KYU_MEMORY_TAGS; ++i)
+        kyu_memory_stats_get((kyu_memory_tag)i, &block->memory[i]);
+
+      kyu_atomic_fence();
+      kyu_atomic_add((kyu_atomic *)&block->sequence, 1);
+    }
+
+  draw_calls = 0;
+  triangles = 0;
+}
+
+int
+kyu_metrics_sample(const char *name, kyu_metrics_block *dest)
+{
+  kyu_metrics_block *mapped;
+  long before, after;
+  int tries;
+
+  KYU_ASSERT(name != NULL, "No metrics name provided");
+  KYU_ASSERT(dest != NULL, "No block provided");
+  if (name == NULL || dest == NULL)
+    return -1;
+
+  mapped = map_block(name, 0);
+  if (mapped == NULL)
+    return -1;
+
+  for (tries = 0; tries < KYU_METRICS_RETRIES; ++tries)
+    {
+      before = kyu_atomic_load((kyu_atomic *)&mapped->sequence);
+      if (before & 1)
+        {
+          kyu_thread_yield();
+          continue;
+        }
+
+      kyu_atomic_fence();
+      memcpy(dest, mapped, sizeof(kyu_metrics_block));
+      kyu_atomic_fence();
+
+      after = kyu_atomic_load((kyu_atomic *)&mapped->sequence);
+      if (before == after)
+        break;
+    }
+
+  unmap_block(mapped);
+
+  if (tries == KYU_METRICS_RETRIES || dest->magic != KYU_METRICS_MAGIC
+      || dest->version != KYU_METRICS_VERSION)
+    return -1;
+
+  return 0;
+}
+
+static kyu_metrics_block *
+map_block(const char *name, int create)
+{
+#if defined(__KYU_WIN__)
+  HANDLE handle;
+  void *view;
+
+  if (create)
+    handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                                sizeof(kyu_metrics_block), name);
+  else
+    handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+  if (handle == NULL)
+    return NULL;
+
+  if (create && GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+      KYU_LOG_WARNING("Metrics block '%s' is used by another process", name);
+      CloseHandle(handle);
+      return NULL;
+    }
+
+  view = MapViewOfFile(handle, create ? FILE_MAP_WRITE : FILE_MAP_READ,
+                       0, 0, sizeof(kyu_metrics_block));
+  if (view == NULL)
+    {
+      CloseHandle(handle);
+      return NULL;
+    }
+
+  /* The writer keeps its handle so the mapping lives as long as it */
+  if (create)
+    mapping = handle;
+  else
+    CloseHandle(handle);
+
+  return (kyu_metrics_block *)view;
+#elif !defined(__KYU_PS2__)
+  void *view;
+  int fd;
+
+  /* Another instance would write into our block, and unlink it */
+  fd = shm_open(name, create ? O_CREAT | O_EXCL | O_RDWR : O_RDONLY, 0644);
+  if (fd < 0 && create && errno == EEXIST && stale_block(name))
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+    return NULL;
+
+  if (create && ftruncate(fd, sizeof(kyu_metrics_block)) != 0)
+    {
+      close(fd);
+      return NULL;
+    }
+
+  view = mmap(NULL, sizeof(kyu_metrics_block),
+              create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  return (view != MAP_FAILED) ? (kyu_metrics_block *)view : NULL;
+#else
+  (void)name;
+  (void)create;
+  return NULL;
+#endif
+}
+
+static void
+unmap_block(kyu_metrics_block *mapped)
+{
+#if defined(__KYU_WIN__)
+  UnmapViewOfFile(mapped);
+  if (mapped == block && mapping != NULL)
+    {
+      CloseHandle(mapping);
+      mapping = NULL;
+    }
+#elif !defined(__KYU_PS2__)
+  munmap(mapped, sizeof(kyu_metrics_block));
+#else
+  (void)mapped;
+#endif
+}
+
+#if !defined(__KYU_WIN__) && !defined(__KYU_PS2__)
+/* A block whose writer died without closing it is unlinked */
+static int
+stale_block(const char *name)
+{
+  kyu_metrics_block *mapped;
+  long pid;
+
+  mapped = map_block(name, 0);
+  if (mapped == NULL)
+    return 0;
+
+  pid = (mapped->magic == KYU_METRICS_MAGIC) ? mapped->pid : 0;
+  unmap_block(mapped);
+
+  if (pid <= 0 || kill((pid_t)pid, 0) == 0 || errno != ESRCH)
+    {
+      KYU_LOG_WARNING("Metrics block '%s' is used by another process", name);
+      return 0;
+    }
+
+  return shm_unlink(name) == 0;
+}
+#endif
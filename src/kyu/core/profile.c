@@ -0,0 +1,242 @@
+/* profile -- scoped-zone CPU profiler
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/core/profile.h"
+#include "kyu/core/clock.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
+#include "core/thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KYU_PROFILE_MASK (KYU_PROFILE_EVENTS - 1)
+
+typedef struct {
+  const char *name;
+  double time;
+  char phase;
+} profile_event;
+
+/* Only its thread writes a buffer, the dump reads up to `count` */
+typedef struct profile_buffer {
+  profile_event events[KYU_PROFILE_EVENTS];
+  kyu_atomic count;
+
+  const char *thread_name;
+  int id;
+  struct profile_buffer *next;
+} profile_buffer;
+
+static KYU_THREAD_LOCAL profile_buffer *buffer = NULL;
+static profile_buffer *buffers = NULL;
+static kyu_atomic nb_buffers = 0;
+static kyu_atomic enabled = 1;
+static double origin = -1.0;
+
+static kyu_mutex mutex;
+static kyu_atomic mutex_ready = 0;
+
+static profile_buffer *attach_buffer(void);
+static void record(const char *name, char phase);
+static void write_name(FILE *file, const char *name);
+
+void
+kyu_profile_begin(const char *name)
+{
+  record(name, 'B');
+}
+
+void
+kyu_profile_end(void)
+{
+  record(NULL, 'E');
+}
+
+void
+kyu_profile_thread_name(const char *name)
+{
+  profile_buffer *b = (buffer != NULL) ? buffer : attach_buffer();
+
+  if (b != NULL)
+    b->thread_name = name;
+}
+
+void
+kyu_profile_enable(int enable)
+{
+  kyu_atomic_store(&enabled, enable != 0);
+}
+
+const char *
+kyu_profile_scope_begin(const char *name)
+{
+  record(name, 'B');
+  return name;
+}
+
+void
+kyu_profile_scope_end(const char **name)
+{
+  (void)name;
+  record(NULL, 'E');
+}
+
+int
+kyu_profile_dump(const char *filename)
+{
+  profile_buffer *b;
+  profile_event *e, *events;
+  FILE *file;
+  long count, first, i;
+  int depth, comma = 0;
+
+  KYU_ASSERT(filename != NULL, "No file name provided");
+  if (filename == NULL || buffers == NULL)
+    return -1;
+
+  events = kyu_malloc(KYU_PROFILE_EVENTS * sizeof(profile_event), KYU_MEMORY_PROFILE);
+  KYU_ASSERT(events != NULL, "Can't allocate memory to dump the profile");
+  if (events == NULL)
+    return -1;
+
+  file = fopen(filename, "w");
+  if (file == NULL)
+    {
+      KYU_LOG_WARNING("Can't open '%s' to write the profile", filename);
+      kyu_free(events);
+      return -1;
+    }
+
+  kyu_mutex_lock(&mutex);
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (b = buffers; b != NULL; b = b->next)
+    {
+      if (b->thread_name != NULL)
+        {
+          fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                  "\"tid\":%d,\"args\":{\"name\":", comma ? ",\n" : "", b->id);
+          write_name(file, b->thread_name);
+          fprintf(file, "}}");
+          comma = 1;
+        }
+
+      /* Events still being written by their thread are left out. The
+         thread keeps recording, so the ring is copied and the events it
+         overwrote meanwhile are dropped: the next one it writes, at
+         index `count`, takes the slot of count - KYU_PROFILE_EVENTS. */
+      count = kyu_atomic_load(&b->count);
+      first = MAX(0, count - KYU_PROFILE_EVENTS);
+      for (i = first; i < count; ++i)
+        events[i & KYU_PROFILE_MASK] = b->events[i & KYU_PROFILE_MASK];
+      kyu_atomic_fence();
+      first = MAX(first, kyu_atomic_load(&b->count) + 1 - KYU_PROFILE_EVENTS);
+
+      /* Nor the ends of zones whose begin was overwritten */
+      depth = 0;
+      for (i = first; i < count; ++i)
+        {
+          e = &events[i & KYU_PROFILE_MASK];
+          if (e->phase == 'E' && depth == 0)
+            continue;
+          depth += (e->phase == 'B') ? 1 : -1;
+
+          fprintf(file, "%s{\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+                  comma ? ",\n" : "", e->phase, b->id, (e->time - origin) * 1e6);
+          if (e->name != NULL)
+            {
+              fprintf(file, ",\"name\":");
+              write_name(file, e->name);
+            }
+          fprintf(file, "}");
+          comma = 1;
+        }
+    }
+  fprintf(file, "\n]}\n");
+  kyu_mutex_unlock(&mutex);
+
+  fclose(file);
+  kyu_free(events);
+
+  return 0;
+}
+
+static void
+record(const char *name, char phase)
+{
+  profile_buffer *b = buffer;
+  profile_event *e;
+  long count;
+
+  if (!kyu_atomic_load(&enabled))
+    return;
+
+  if (b == NULL && (b = attach_buffer()) == NULL)
+    return;
+
+  count = b->count;
+  e = &b->events[count & KYU_PROFILE_MASK];
+  e->name  = name;
+  e->phase = phase;
+  e->time  = kyu_clock_now();
+  kyu_atomic_store(&b->count, count + 1);
+}
+
+/* First event of a thread: its buffer joins the list read by the dump */
+static profile_buffer *
+attach_buffer(void)
+{
+  profile_buffer *b;
+
+  if (kyu_atomic_cas(&mutex_ready, 0, 1))
+    {
+      kyu_mutex_init(&mutex);
+      origin = kyu_clock_now();
+      kyu_atomic_store(&mutex_ready, 2);
+    }
+  while (kyu_atomic_load(&mutex_ready) != 2)
+    kyu_thread_yield();
+
+  b = kyu_calloc(1, sizeof(profile_buffer), KYU_MEMORY_PROFILE);
+  KYU_ASSERT(b != NULL, "Can't allocate memory for the profile events");
+  if (b == NULL)
+    return NULL;
+
+  kyu_mutex_lock(&mutex);
+  b->id = (int)kyu_atomic_add(&nb_buffers, 1);
+  b->next = buffers;
+  buffers = b;
+  kyu_mutex_unlock(&mutex);
+
+  buffer = b;
+
+  return b;
+}
+
+static void
+write_name(FILE *file, const char *name)
+{
+  fputc('"', file);
+  for (; *name != '\0'; ++name)
+    {
+      if (*name == '"' || *name == '\\')
+        fputc('\\', file);
+      if ((unsigned char)*name >= 0x20)
+        fputc(*name, file);
+    }
+  fputc('"', file);
+}
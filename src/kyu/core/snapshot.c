@@ -0,0 +1,127 @@
+/* snapshot -- state handoff between the update and render loops
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "core/snapshot.h"
+#include "kyu/core/memory.h"
+
+#include <stdlib.h>
+
+#define SLOT(S, I) ((void *)((S)->slots + (size_t)(I) * (S)->size))
+
+int
+kyu_snapshots_init(kyu_snapshots *snapshots, size_t size)
+{
+  int i;
+
+  KYU_ASSERT(snapshots != NULL, "No snapshots provided");
+  KYU_ASSERT(size > 0, "Snapshot size is 0");
+  if (snapshots == NULL || size == 0)
+    return -1;
+
+  snapshots->slots = kyu_calloc(KYU_SNAPSHOT_SLOTS, size, KYU_MEMORY_CORE);
+  KYU_ASSERT(snapshots->slots != NULL, "Can't allocate memory for the snapshots");
+  if (snapshots->slots == NULL)
+    return -1;
+
+  snapshots->size       = size;
+  snapshots->writing    = -1;
+  snapshots->latest     = -1;
+  snapshots->previous   = -1;
+  snapshots->reading[0] = -1;
+  snapshots->reading[1] = -1;
+
+  for (i = 0; i < KYU_SNAPSHOT_SLOTS; ++i)
+    snapshots->times[i] = 0.0;
+
+  kyu_mutex_init(&snapshots->mutex);
+
+  return 0;
+}
+
+void
+kyu_snapshots_release(kyu_snapshots *snapshots)
+{
+  KYU_ASSERT(snapshots != NULL, "No snapshots provided");
+  if (snapshots == NULL || snapshots->slots == NULL)
+    return;
+
+  kyu_mutex_destroy(&snapshots->mutex);
+  kyu_free(snapshots->slots);
+  snapshots->slots = NULL;
+}
+
+void *
+kyu_snapshots_begin_write(kyu_snapshots *snapshots)
+{
+  int i;
+
+  kyu_mutex_lock(&snapshots->mutex);
+  for (i = 0; i < KYU_SNAPSHOT_SLOTS; ++i)
+    {
+      if (i != snapshots->latest && i != snapshots->previous
+          && i != snapshots->reading[0] && i != snapshots->reading[1])
+        break;
+    }
+  snapshots->writing = i;
+  kyu_mutex_unlock(&snapshots->mutex);
+
+  return SLOT(snapshots, i);
+}
+
+void
+kyu_snapshots_end_write(kyu_snapshots *snapshots, double time)
+{
+  kyu_mutex_lock(&snapshots->mutex);
+  snapshots->times[snapshots->writing] = time;
+  snapshots->previous = snapshots->latest;
+  snapshots->latest   = snapshots->writing;
+  snapshots->writing  = -1;
+  kyu_mutex_unlock(&snapshots->mutex);
+}
+
+int
+kyu_snapshots_acquire(kyu_snapshots *snapshots,
+                      void **prev, void **next, double *next_time)
+{
+  int count;
+
+  kyu_mutex_lock(&snapshots->mutex);
+  snapshots->reading[0] = snapshots->previous;
+  snapshots->reading[1] = snapshots->latest;
+  kyu_mutex_unlock(&snapshots->mutex);
+
+  count = (snapshots->reading[1] >= 0) + (snapshots->reading[0] >= 0);
+  if (count == 0)
+    return 0;
+
+  *next = SLOT(snapshots, snapshots->reading[1]);
+  *prev = (count == 2) ? SLOT(snapshots, snapshots->reading[0]) : *next;
+
+  if (next_time != NULL)
+    *next_time = snapshots->times[snapshots->reading[1]];
+
+  return count;
+}
+
+void
+kyu_snapshots_release_read(kyu_snapshots *snapshots)
+{
+  kyu_mutex_lock(&snapshots->mutex);
+  snapshots->reading[0] = -1;
+  snapshots->reading[1] = -1;
+  kyu_mutex_unlock(&snapshots->mutex);
+}
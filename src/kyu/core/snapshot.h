@@ -0,0 +1,56 @@
+/* snapshot -- state handoff between the update and render loops
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_SNAPSHOT_H
+#define KYU_SNAPSHOT_H
+
+#include <stddef.h>
+
+#include "core/thread.h"
+
+/* The reader holds the two latest snapshots while it interpolates and the
+   writer needs a slot that is neither held nor one of the two latest, so
+   five slots are always enough for the writer to never wait. */
+#define KYU_SNAPSHOT_SLOTS 5
+
+typedef struct {
+  size_t size;
+  unsigned char *slots;
+  double times[KYU_SNAPSHOT_SLOTS];
+
+  int writing;
+  int latest;
+  int previous;
+  int reading[2];
+
+  kyu_mutex mutex;
+} kyu_snapshots;
+
+int  kyu_snapshots_init(kyu_snapshots *snapshots, size_t size);
+void kyu_snapshots_release(kyu_snapshots *snapshots);
+
+/* Writer side, one thread only */
+void *kyu_snapshots_begin_write(kyu_snapshots *snapshots);
+void  kyu_snapshots_end_write(kyu_snapshots *snapshots, double time);
+
+/* Reader side, returns the number of snapshots published so far (at most
+   2). `prev` and `next` stay valid until kyu_snapshots_release_read. */
+int  kyu_snapshots_acquire(kyu_snapshots *snapshots,
+                           void **prev, void **next, double *next_time);
+void kyu_snapshots_release_read(kyu_snapshots *snapshots);
+
+#endif /* KYU_SNAPSHOT_H */
@@ -0,0 +1,241 @@
+/* stats -- frame-time histograms and percentiles
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/core/stats.h"
+#include "kyu/core/utils.h"
+#include "core/thread.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The window histogram forgets the samples leaving the ring, the session
+   one keeps everything */
+typedef struct {
+  float window[KYU_STATS_WINDOW];
+  unsigned int histogram[KYU_STATS_BUCKETS];
+  unsigned long session[KYU_STATS_BUCKETS];
+  long count;
+  double sum;
+  double max;
+} stats_series;
+
+static stats_series series[KYU_STATS];
+
+static const char *names[KYU_STATS] = {
+  "frame", "update", "render", "wait", "swap", "gpu"
+};
+
+static kyu_mutex mutex;
+static kyu_atomic mutex_ready = 0;
+
+static void   lock(void);
+static int    bucket(double seconds);
+static double bucket_bound(int index);
+static double percentile(const unsigned long *counts, const unsigned int *window,
+                         long samples, double max, double p);
+
+void
+kyu_stats_record(kyu_stat stat, double seconds)
+{
+  stats_series *s;
+  float sample;
+  int b;
+
+  KYU_ASSERT(stat < KYU_STATS, "Bad stat");
+  if (stat >= KYU_STATS)
+    return;
+
+  /* The bucket comes from the stored value so that it is found again
+     when the sample leaves the window */
+  s = &series[stat];
+  sample = (float)MAX(seconds, 0.0);
+  b = bucket(sample);
+
+  lock();
+  if (s->count >= KYU_STATS_WINDOW)
+    s->histogram[bucket(s->window[s->count % KYU_STATS_WINDOW])]--;
+
+  s->window[s->count % KYU_STATS_WINDOW] = sample;
+  s->histogram[b]++;
+  s->session[b]++;
+  s->count++;
+  s->sum += sample;
+  s->max = MAX(s->max, (double)sample);
+  kyu_mutex_unlock(&mutex);
+}
+
+void
+kyu_stats_reset(void)
+{
+  lock();
+  memset(series, 0, sizeof(series));
+  kyu_mutex_unlock(&mutex);
+}
+
+int
+kyu_stats_get(kyu_stat stat, kyu_stats_summary *summary)
+{
+  stats_series *s;
+  long samples, i;
+  double sum = 0.0, max = 0.0;
+
+  KYU_ASSERT(stat < KYU_STATS, "Bad stat");
+  KYU_ASSERT(summary != NULL, "No summary provided");
+  if (stat >= KYU_STATS || summary == NULL)
+    return -1;
+
+  s = &series[stat];
+
+  lock();
+  samples = MIN(s->count, (long)KYU_STATS_WINDOW);
+  for (i = 0; i < samples; ++i)
+    {
+      sum += s->window[i];
+      max = MAX(max, (double)s->window[i]);
+    }
+
+  summary->samples = samples;
+  summary->mean    = (samples > 0) ? sum / (double)samples : 0.0;
+  summary->max     = max;
+  summary->p50     = percentile(NULL, s->histogram, samples, max, 0.50);
+  summary->p95     = percentile(NULL, s->histogram, samples, max, 0.95);
+  summary->p99     = percentile(NULL, s->histogram, samples, max, 0.99);
+  kyu_mutex_unlock(&mutex);
+
+  return 0;
+}
+
+int
+kyu_stats_get_session(kyu_stat stat, kyu_stats_summary *summary)
+{
+  stats_series *s;
+
+  KYU_ASSERT(stat < KYU_STATS, "Bad stat");
+  KYU_ASSERT(summary != NULL, "No summary provided");
+  if (stat >= KYU_STATS || summary == NULL)
+    return -1;
+
+  s = &series[stat];
+
+  lock();
+  summary->samples = s->count;
+  summary->mean    = (s->count > 0) ? s->sum / (double)s->count : 0.0;
+  summary->max     = s->max;
+  summary->p50     = percentile(s->session, NULL, s->count, s->max, 0.50);
+  summary->p95     = percentile(s->session, NULL, s->count, s->max, 0.95);
+  summary->p99     = percentile(s->session, NULL, s->count, s->max, 0.99);
+  kyu_mutex_unlock(&mutex);
+
+  return 0;
+}
+
+const char *
+kyu_stats_name(kyu_stat stat)
+{
+  return (stat < KYU_STATS) ? names[stat] : "unknown";
+}
+
+int
+kyu_stats_dump(const char *filename)
+{
+  kyu_stats_summary summary;
+  FILE *file;
+  int i;
+
+  KYU_ASSERT(filename != NULL, "No file name provided");
+  if (filename == NULL)
+    return -1;
+
+  file = fopen(filename, "w");
+  if (file == NULL)
+    {
+      KYU_LOG_WARNING("Can't open '%s' to write the stats", filename);
+      return -1;
+    }
+
+  fprintf(file, "stat,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+  for (i = 0; i < KYU_STATS; ++i)
+    {
+      kyu_stats_get_session((kyu_stat)i, &summary);
+      fprintf(file, "%s,%ld,%.3f,%.3f,%.3f,%.3f,%.3f\n", names[i],
+              summary.samples, summary.mean * 1e3, summary.p50 * 1e3,
+              summary.p95 * 1e3, summary.p99 * 1e3, summary.max * 1e3);
+    }
+
+  fclose(file);
+
+  return 0;
+}
+
+/* Taken on first use, the series may be recorded before anything else
+   of kyu is set up */
+static void
+lock(void)
+{
+  if (kyu_atomic_cas(&mutex_ready, 0, 1))
+    {
+      kyu_mutex_init(&mutex);
+      kyu_atomic_store(&mutex_ready, 2);
+    }
+  while (kyu_atomic_load(&mutex_ready) != 2)
+    kyu_thread_yield();
+
+  kyu_mutex_lock(&mutex);
+}
+
+static int
+bucket(double seconds)
+{
+  int index;
+
+  if (seconds <= KYU_STATS_MIN)
+    return 0;
+
+  index = 1 + (int)(log(seconds / KYU_STATS_MIN) / log(KYU_STATS_GROWTH));
+
+  return MIN(index, KYU_STATS_BUCKETS - 1);
+}
+
+static double
+bucket_bound(int index)
+{
+  return KYU_STATS_MIN * pow(KYU_STATS_GROWTH, index);
+}
+
+/* Exactly one of the two histograms is given, a bucket bound never
+   reports more than the largest sample */
+static double
+percentile(const unsigned long *counts, const unsigned int *window,
+           long samples, double max, double p)
+{
+  long rank, seen = 0;
+  int i;
+
+  if (samples <= 0)
+    return 0.0;
+
+  rank = (long)ceil(p * (double)samples);
+  for (i = 0; i < KYU_STATS_BUCKETS; ++i)
+    {
+      seen += (counts != NULL) ? (long)counts[i] : (long)window[i];
+      if (seen >= rank)
+        return MIN(bucket_bound(i), max);
+    }
+
+  return max;
+}
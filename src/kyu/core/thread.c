@@ -0,0 +1,257 @@
+/* thread -- minimal threads, locks and atomics
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#if defined(__unix__) || defined(__unix) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#endif
+
+#include "kyu/core/memory.h"
+#include "core/thread.h"
+
+#include <stdlib.h>
+
+#if !defined(KYU_NO_THREADS) && !defined(__KYU_WIN__)
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if !defined(KYU_NO_THREADS) && defined(__KYU_WIN__)
+typedef struct {
+  void *(*func)(void *);
+  void *data;
+} thread_start;
+
+static DWORD WINAPI
+thread_trampoline(LPVOID param)
+{
+  thread_start start = *(thread_start *)param;
+
+  kyu_free(param);
+  start.func(start.data);
+
+  return 0;
+}
+#endif /* !KYU_NO_THREADS && __KYU_WIN__ */
+
+int
+kyu_thread_create(kyu_thread *thread, void *(*func)(void *), void *data)
+{
+  KYU_ASSERT(thread != NULL, "No thread provided");
+  KYU_ASSERT(func != NULL, "No thread function provided");
+  if (thread == NULL || func == NULL)
+    return -1;
+
+#if defined(KYU_NO_THREADS)
+  (void)data;
+  return -1;
+#elif defined(__KYU_WIN__)
+  {
+    thread_start *start = kyu_malloc(sizeof(thread_start), KYU_MEMORY_CORE);
+
+    if (start == NULL)
+      return -1;
+
+    start->func = func;
+    start->data = data;
+
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*thread == NULL)
+      {
+        kyu_free(start);
+        return -1;
+      }
+
+    return 0;
+  }
+#else
+  return (pthread_create(thread, NULL, func, data) == 0) ? 0 : -1;
+#endif
+}
+
+void
+kyu_thread_join(kyu_thread *thread)
+{
+  KYU_ASSERT(thread != NULL, "No thread provided");
+  if (thread == NULL)
+    return;
+
+#if defined(KYU_NO_THREADS)
+  (void)thread;
+#elif defined(__KYU_WIN__)
+  WaitForSingleObject(*thread, INFINITE);
+  CloseHandle(*thread);
+#else
+  pthread_join(*thread, NULL);
+#endif
+}
+
+void
+kyu_thread_yield(void)
+{
+#if defined(KYU_NO_THREADS)
+#elif defined(__KYU_WIN__)
+  SwitchToThread();
+#else
+  sched_yield();
+#endif
+}
+
+void
+kyu_thread_sleep(double seconds)
+{
+  if (seconds <= 0.0)
+    return;
+
+#if defined(KYU_NO_THREADS)
+#elif defined(__KYU_WIN__)
+  Sleep((DWORD)(seconds * 1000.0));
+#else
+  {
+    struct timespec ts;
+
+    ts.tv_sec  = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+  }
+#endif
+}
+
+int
+kyu_thread_hardware_count(void)
+{
+#if defined(KYU_NO_THREADS)
+  return 1;
+#elif defined(__KYU_WIN__)
+  SYSTEM_INFO info;
+
+  GetSystemInfo(&info);
+  return MAX((int)info.dwNumberOfProcessors, 1);
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return (count > 0) ? (int)count : 1;
+#endif
+}
+
+void
+kyu_mutex_init(kyu_mutex *mutex)
+{
+#if defined(KYU_NO_THREADS)
+  *mutex = 0;
+#elif defined(__KYU_WIN__)
+  InitializeCriticalSection(mutex);
+#else
+  pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void
+kyu_mutex_destroy(kyu_mutex *mutex)
+{
+#if defined(KYU_NO_THREADS)
+  (void)mutex;
+#elif defined(__KYU_WIN__)
+  DeleteCriticalSection(mutex);
+#else
+  pthread_mutex_destroy(mutex);
+#endif
+}
+
+void
+kyu_mutex_lock(kyu_mutex *mutex)
+{
+#if defined(KYU_NO_THREADS)
+  (void)mutex;
+#elif defined(__KYU_WIN__)
+  EnterCriticalSection(mutex);
+#else
+  pthread_mutex_lock(mutex);
+#endif
+}
+
+void
+kyu_mutex_unlock(kyu_mutex *mutex)
+{
+#if defined(KYU_NO_THREADS)
+  (void)mutex;
+#elif defined(__KYU_WIN__)
+  LeaveCriticalSection(mutex);
+#else
+  pthread_mutex_unlock(mutex);
+#endif
+}
+
+void
+kyu_cond_init(kyu_cond *cond)
+{
+#if defined(KYU_NO_THREADS)
+  *cond = 0;
+#elif defined(__KYU_WIN__)
+  InitializeConditionVariable(cond);
+#else
+  pthread_cond_init(cond, NULL);
+#endif
+}
+
+void
+kyu_cond_destroy(kyu_cond *cond)
+{
+#if defined(KYU_NO_THREADS) || defined(__KYU_WIN__)
+  (void)cond;
+#else
+  pthread_cond_destroy(cond);
+#endif
+}
+
+void
+kyu_cond_wait(kyu_cond *cond, kyu_mutex *mutex)
+{
+#if defined(KYU_NO_THREADS)
+  (void)cond;
+  (void)mutex;
+#elif defined(__KYU_WIN__)
+  SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+  pthread_cond_wait(cond, mutex);
+#endif
+}
+
+void
+kyu_cond_signal(kyu_cond *cond)
+{
+#if defined(KYU_NO_THREADS)
+  (void)cond;
+#elif defined(__KYU_WIN__)
+  WakeConditionVariable(cond);
+#else
+  pthread_cond_signal(cond);
+#endif
+}
+
+void
+kyu_cond_broadcast(kyu_cond *cond)
+{
+#if defined(KYU_NO_THREADS)
+  (void)cond;
+#elif defined(__KYU_WIN__)
+  WakeAllConditionVariable(cond);
+#else
+  pthread_cond_broadcast(cond);
+#endif
+}
@@ -0,0 +1,113 @@
+/* thread -- minimal threads, locks and atomics
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_THREAD_H
+#define KYU_THREAD_H
+
+#include "kyu/core/utils.h"
+
+/* The PS2 build is single-threaded: the functions below exist but
+   kyu_thread_create always fails and the locks do nothing. */
+#if defined(__KYU_PS2__)
+#define KYU_NO_THREADS
+#endif
+
+#if defined(KYU_NO_THREADS)
+typedef int kyu_thread;
+typedef int kyu_mutex;
+typedef int kyu_cond;
+#elif defined(__KYU_WIN__)
+#include <windows.h>
+typedef HANDLE kyu_thread;
+typedef CRITICAL_SECTION kyu_mutex;
+typedef CONDITION_VARIABLE kyu_cond;
+#else
+#include <pthread.h>
+typedef pthread_t kyu_thread;
+typedef pthread_mutex_t kyu_mutex;
+typedef pthread_cond_t kyu_cond;
+#endif
+
+typedef volatile long kyu_atomic;
+
+#if defined(KYU_NO_THREADS)
+#define KYU_THREAD_LOCAL
+#elif defined(_MSC_VER)
+#define KYU_THREAD_LOCAL __declspec(thread)
+#else
+#define KYU_THREAD_LOCAL __thread
+#endif
+
+int  kyu_thread_create(kyu_thread *thread, void *(*func)(void *), void *data);
+void kyu_thread_join(kyu_thread *thread);
+void kyu_thread_yield(void);
+void kyu_thread_sleep(double seconds);
+int  kyu_thread_hardware_count(void);
+
+void kyu_mutex_init(kyu_mutex *mutex);
+void kyu_mutex_destroy(kyu_mutex *mutex);
+void kyu_mutex_lock(kyu_mutex *mutex);
+void kyu_mutex_unlock(kyu_mutex *mutex);
+
+void kyu_cond_init(kyu_cond *cond);
+void kyu_cond_destroy(kyu_cond *cond);
+void kyu_cond_wait(kyu_cond *cond, kyu_mutex *mutex);
+void kyu_cond_signal(kyu_cond *cond);
+void kyu_cond_broadcast(kyu_cond *cond);
+
+/* Sequentially consistent atomics, kyu_atomic_add returns the previous
+   value and kyu_atomic_cas returns 1 when the exchange happened. The
+   fence orders the plain accesses around it. */
+#if defined(KYU_NO_THREADS)
+#define kyu_atomic_fence()      ((void)0)
+#define kyu_atomic_load(P)      (*(P))
+#define kyu_atomic_store(P, V)  (*(P) = (V))
+static inline long
+kyu_atomic_add(kyu_atomic *p, long v)
+{
+  long old = *p;
+  *p += v;
+  return old;
+}
+static inline int
+kyu_atomic_cas(kyu_atomic *p, long expected, long desired)
+{
+  if (*p != expected)
+    return 0;
+  *p = desired;
+  return 1;
+}
+#elif defined(_MSC_VER)
+#define kyu_atomic_fence()      MemoryBarrier()
+#define kyu_atomic_load(P)      InterlockedOr((P), 0)
+#define kyu_atomic_store(P, V)  InterlockedExchange((P), (V))
+#define kyu_atomic_add(P, V)    InterlockedExchangeAdd((P), (V))
+#define kyu_atomic_cas(P, E, D) (InterlockedCompareExchange((P), (D), (E)) == (E))
+#else
+#define kyu_atomic_fence()      __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define kyu_atomic_load(P)      __atomic_load_n((P), __ATOMIC_SEQ_CST)
+#define kyu_atomic_store(P, V)  __atomic_store_n((P), (V), __ATOMIC_SEQ_CST)
+#define kyu_atomic_add(P, V)    __atomic_fetch_add((P), (V), __ATOMIC_SEQ_CST)
+static inline int
+kyu_atomic_cas(kyu_atomic *p, long expected, long desired)
+{
+  return __atomic_compare_exchange_n(p, &expected, desired, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#endif
+
+#endif /* KYU_THREAD_H */
@@ -16,60 +16,490 @@
    along with this program. If not, see <http://www.gnu.org/licenses/>. */
 
 #include "kyu/core/utils.h"
+#include "kyu/core/clock.h"
+#include "core/thread.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __KYU_WIN__
+#  include <io.h>
+#  define write _write
+#else
+#  include <unistd.h>
+#endif
+
+/* Where a crash handler writes, without stdio */
+#ifdef __KYU_PS2__
+#  define CRASH_FD 1
+#else
+#  define CRASH_FD 2
+#endif
 
 #define KYU_LOG_MESSAGE_SIZE 256
 
+/* Records in the queue, a power of 2 */
+#define KYU_LOG_QUEUE 1024
+#define KYU_LOG_QUEUE_MASK (KYU_LOG_QUEUE - 1)
+
+/* Call sites tracked by the rate limiter, a power of 2 */
+#define KYU_LOG_SITES 256
+
+typedef struct {
+  kyu_log_type type;
+  const char *file;
+  int line;
+  char message[KYU_LOG_MESSAGE_SIZE];
+} log_record;
+
+/* Bounded queue from D. Vyukov: a cell is free for the producer that
+   reserved position `pos` when its sequence is pos, and ready for the
+   consumer when it is pos + 1 */
+typedef struct {
+  kyu_atomic sequence;
+  log_record record;
+} log_cell;
+
+typedef struct {
+  kyu_atomic key;
+  kyu_atomic second;
+  kyu_atomic count;
+  kyu_atomic muted;
+} log_site;
+
+static log_cell queue[KYU_LOG_QUEUE];
+static kyu_atomic enqueue_pos = 0;
+static kyu_atomic dequeue_pos = 0;
+static kyu_atomic written = 0;
+static kyu_atomic dropped = 0;
+
+static log_site sites[KYU_LOG_SITES];
+static kyu_atomic level = KYU_LOG_LEVEL_ALL;
+
+static kyu_atomic running = 0;
+static kyu_atomic sleeping = 0;
+static kyu_thread writer;
+static kyu_mutex mutex;
+static kyu_cond cond;
+
+static const int crash_signals[] = {
+  SIGSEGV, SIGABRT, SIGFPE, SIGILL,
+#ifdef SIGBUS
+  SIGBUS,
+#endif
+};
+#define NB_CRASH_SIGNALS ((int)(sizeof(crash_signals) / sizeof(crash_signals[0])))
+static void (*previous_handlers[NB_CRASH_SIGNALS])(int);
+
+static int   muted(const char *file, int line, const char *text, long *count);
+static void  submit(const log_record *record);
+static int   push(const log_record *record);
+static int   pop(log_record *record);
+static int   queue_empty(void);
+static void  drain(void);
+static const char *type_message(kyu_log_type type);
+static void  write_record(const log_record *record);
+static void  write_raw(const char *text);
+static void  write_raw_record(const log_record *record);
+static void *writer_main(void *data);
+static void  crash_handler(int sig);
+
 void
 kyu_log(kyu_log_type type, const char *restrict file, int line,
         const char *restrict message, ...)
 {
-  char *type_message, log_message[KYU_LOG_MESSAGE_SIZE];
-  
+  log_record record;
+  long count = 0;
   va_list args;
+
+  if (KYU_LOG_SEVERITY(type) < kyu_atomic_load(&level))
+    return;
+
+  /* Only the formatting happens on the calling thread, the arguments
+     can't outlive the call */
   va_start(args, message);
+  vsnprintf(record.message, KYU_LOG_MESSAGE_SIZE, message, args);
+  va_end(args);
 
-  vsnprintf(log_message, KYU_LOG_MESSAGE_SIZE - 1, message, args);
+  if (muted(file, line, record.message, &count))
+    return;
 
-  log_message[KYU_LOG_MESSAGE_SIZE - 1] = '\0';
+  record.type = type;
+  record.file = file;
+  record.line = line;
 
-  va_end(args);
+  if (count > 0)
+    {
+      log_record note = record;
+
+      snprintf(note.message, KYU_LOG_MESSAGE_SIZE,
+               "%ld similar messages were muted", count);
+      submit(&note);
+    }
+
+  submit(&record);
+}
+
+int
+kyu_log_init(void)
+{
+  static int registered = 0;
+  int i;
+
+  if (kyu_atomic_load(&running))
+    return 0;
+
+  for (i = 0; i < KYU_LOG_QUEUE; ++i)
+    queue[i].sequence = i;
+  enqueue_pos = 0;
+  dequeue_pos = 0;
+  written = 0;
+
+  kyu_mutex_init(&mutex);
+  kyu_cond_init(&cond);
+
+  kyu_atomic_store(&running, 1);
+  if (kyu_thread_create(&writer, writer_main, NULL) != 0)
+    {
+      /* Synchronous logging */
+      kyu_atomic_store(&running, 0);
+      kyu_cond_destroy(&cond);
+      kyu_mutex_destroy(&mutex);
+      return -1;
+    }
+
+  for (i = 0; i < NB_CRASH_SIGNALS; ++i)
+    previous_handlers[i] = signal(crash_signals[i], crash_handler);
+
+  if (!registered)
+    registered = (atexit(kyu_log_flush) == 0);
+
+  return 0;
+}
+
+void
+kyu_log_quit(void)
+{
+  int i;
+
+  if (!kyu_atomic_load(&running))
+    return;
+
+  kyu_mutex_lock(&mutex);
+  kyu_atomic_store(&running, 0);
+  kyu_cond_signal(&cond);
+  kyu_mutex_unlock(&mutex);
+
+  kyu_thread_join(&writer);
+  kyu_cond_destroy(&cond);
+  kyu_mutex_destroy(&mutex);
+
+  for (i = 0; i < NB_CRASH_SIGNALS; ++i)
+    signal(crash_signals[i], previous_handlers[i]);
+
+  /* Records pushed while the writer was stopping */
+  drain();
+  fflush(KYU_STDERR);
+}
+
+void
+kyu_log_flush(void)
+{
+  long target;
+
+  if (kyu_atomic_load(&running))
+    {
+      /* Help the writer, then wait for the records it already took */
+      target = kyu_atomic_load(&enqueue_pos);
+      drain();
+      while (kyu_atomic_load(&written) < target
+             && kyu_atomic_load(&running))
+        kyu_thread_yield();
+    }
+
+  fflush(KYU_STDERR);
+}
+
+void
+kyu_log_set_level(int new_level)
+{
+  kyu_atomic_store(&level, new_level);
+}
+
+/* At most KYU_LOG_RATE messages per second and call site, messages with
+   no call site are told apart by their text. The muted ones are counted
+   in the next message of the site. */
+static int
+muted(const char *file, int line, const char *text, long *count)
+{
+  log_site *site;
+  unsigned long key;
+  long second;
+
+  if (file != NULL)
+    key = (unsigned long)(uintptr_t)file * 31ul + (unsigned long)line;
+  else
+    {
+      key = 2166136261ul;
+      for (; *text != '\0'; ++text)
+        key = (key ^ (unsigned char)*text) * 16777619ul;
+    }
+
+  key &= 0x7ffffffful;
+  site = &sites[key % KYU_LOG_SITES];
+  second = (long)kyu_clock_now();
+
+  if (kyu_atomic_load(&site->key) != (long)key)
+    {
+      kyu_atomic_store(&site->key, (long)key);
+      kyu_atomic_store(&site->second, second);
+      kyu_atomic_store(&site->count, 0);
+      kyu_atomic_store(&site->muted, 0);
+    }
+  else if (kyu_atomic_load(&site->second) != second)
+    {
+      kyu_atomic_store(&site->second, second);
+      kyu_atomic_store(&site->count, 0);
+      *count = kyu_atomic_load(&site->muted);
+      kyu_atomic_add(&site->muted, -*count);
+    }
+
+  if (kyu_atomic_add(&site->count, 1) >= KYU_LOG_RATE)
+    {
+      kyu_atomic_add(&site->muted, 1);
+      return 1;
+    }
+
+  return 0;
+}
+
+static void
+submit(const log_record *record)
+{
+  if (!kyu_atomic_load(&running))
+    {
+      write_record(record);
+      return;
+    }
+
+  /* Never block the caller, a full queue drops the record */
+  if (!push(record))
+    {
+      kyu_atomic_add(&dropped, 1);
+      return;
+    }
+
+  if (kyu_atomic_load(&sleeping))
+    {
+      kyu_mutex_lock(&mutex);
+      kyu_cond_signal(&cond);
+      kyu_mutex_unlock(&mutex);
+    }
+}
+
+static int
+push(const log_record *record)
+{
+  log_cell *cell;
+  long pos, diff;
+
+  pos = kyu_atomic_load(&enqueue_pos);
+  for (;;)
+    {
+      cell = &queue[pos & KYU_LOG_QUEUE_MASK];
+      diff = kyu_atomic_load(&cell->sequence) - pos;
+
+      if (diff == 0 && kyu_atomic_cas(&enqueue_pos, pos, pos + 1))
+        break;
+      else if (diff < 0)
+        return 0;
+
+      pos = kyu_atomic_load(&enqueue_pos);
+    }
+
+  cell->record = *record;
+  kyu_atomic_store(&cell->sequence, pos + 1);
+
+  return 1;
+}
+
+static int
+pop(log_record *record)
+{
+  log_cell *cell;
+  long pos, diff;
+
+  pos = kyu_atomic_load(&dequeue_pos);
+  for (;;)
+    {
+      cell = &queue[pos & KYU_LOG_QUEUE_MASK];
+      diff = kyu_atomic_load(&cell->sequence) - (pos + 1);
+
+      if (diff == 0 && kyu_atomic_cas(&dequeue_pos, pos, pos + 1))
+        break;
+      else if (diff < 0)
+        return 0;
+
+      pos = kyu_atomic_load(&dequeue_pos);
+    }
+
+  *record = cell->record;
+  kyu_atomic_store(&cell->sequence, pos + KYU_LOG_QUEUE);
+
+  return 1;
+}
+
+static int
+queue_empty(void)
+{
+  long pos = kyu_atomic_load(&dequeue_pos);
+
+  return kyu_atomic_load(&queue[pos & KYU_LOG_QUEUE_MASK].sequence) != pos + 1;
+}
+
+static void
+drain(void)
+{
+  log_record record;
+  long count;
 
+  while (pop(&record))
+    {
+      write_record(&record);
+      kyu_atomic_add(&written, 1);
+    }
+
+  count = kyu_atomic_load(&dropped);
+  if (count > 0)
+    {
+      kyu_atomic_add(&dropped, -count);
+      fprintf(KYU_STDERR, BOLD YELLOW "[WARNING]" RESET YELLOW
+              " - %ld messages dropped, the log queue was full" RESET "\n",
+              count);
+    }
+}
+
+static const char *
+type_message(kyu_log_type type)
+{
   switch (type)
     {
     case LOG:
-      type_message = "[LOG]";
-      break;
+      return "[LOG]";
       
     case WARNING:
-      type_message = BOLD YELLOW "[WARNING]" RESET YELLOW;
-      break;
+      return BOLD YELLOW "[WARNING]" RESET YELLOW;
 
     case ERROR:
-      type_message = BOLD RED "[ERROR]" RESET RED;
-      break;
+      return BOLD RED "[ERROR]" RESET RED;
 
     case GL_LOG:
-      type_message = "[GL LOG]";
-      break;
+      return "[GL LOG]";
 
     case GL_WARNING:
-      type_message = BOLD YELLOW "[GL WARNING]" RESET YELLOW;
-      break;
+      return BOLD YELLOW "[GL WARNING]" RESET YELLOW;
       
     case GL_ERROR:
-      type_message = BOLD RED "[GL ERROR]" RESET RED;
-      break;
+      return BOLD RED "[GL ERROR]" RESET RED;
 
     default:
-      type_message = "\0";
-      break;
+      return "\0";
     }
+}
 
-  if (file == NULL)
-    fprintf(KYU_STDERR, "%s - %s" RESET "\n", type_message, log_message);
+static void
+write_record(const log_record *record)
+{
+  if (record->file == NULL)
+    fprintf(KYU_STDERR, "%s - %s" RESET "\n", type_message(record->type),
+            record->message);
   else
-    fprintf(KYU_STDERR, "%s:%d: %s - %s" RESET "\n", file, line, type_message, log_message);
+    fprintf(KYU_STDERR, "%s:%d: %s - %s" RESET "\n", record->file, record->line,
+            type_message(record->type), record->message);
+}
+
+static void
+write_raw(const char *text)
+{
+  size_t length = strlen(text);
+
+  if (write(CRASH_FD, text, length) < 0)
+    return;
+}
+
+/* Same layout as write_record, the line number is the only thing left
+   to format */
+static void
+write_raw_record(const log_record *record)
+{
+  char line[16];
+  int i = (int)sizeof(line) - 1;
+  unsigned int n = (record->line > 0) ? (unsigned int)record->line : 0u;
+
+  line[i] = '\0';
+  do
+    line[--i] = (char)('0' + n % 10);
+  while ((n /= 10) > 0 && i > 0);
+
+  if (record->file != NULL)
+    {
+      write_raw(record->file);
+      write_raw(":");
+      write_raw(&line[i]);
+      write_raw(": ");
+    }
+  write_raw(type_message(record->type));
+  write_raw(" - ");
+  write_raw(record->message);
+  write_raw(RESET "\n");
+}
+
+static void *
+writer_main(void *data)
+{
+  (void)data;
+
+  while (kyu_atomic_load(&running))
+    {
+      drain();
+
+      /* submit() only signals when the writer sleeps, so sleeping must be
+         raised before the queue is checked */
+      kyu_mutex_lock(&mutex);
+      kyu_atomic_store(&sleeping, 1);
+      while (queue_empty() && kyu_atomic_load(&running))
+        kyu_cond_wait(&cond, &mutex);
+      kyu_atomic_store(&sleeping, 0);
+      kyu_mutex_unlock(&mutex);
+    }
+
+  drain();
+
+  return NULL;
+}
+
+/* Best effort: write what is queued, then let the handler that was
+   there before, or the default action, see the signal. Only the
+   lock-free queue and write(2) are used, stdio is not safe here. */
+static void
+crash_handler(int sig)
+{
+  void (*previous)(int) = SIG_DFL;
+  log_record record;
+  int i;
+
+  while (pop(&record))
+    write_raw_record(&record);
+
+  /* An ignored crash signal would come back as soon as we return */
+  for (i = 0; i < NB_CRASH_SIGNALS; ++i)
+    if (crash_signals[i] == sig && previous_handlers[i] != SIG_ERR
+        && previous_handlers[i] != SIG_IGN)
+      previous = previous_handlers[i];
+
+  signal(sig, previous);
+  raise(sig);
 }
@@ -0,0 +1,298 @@
+/* batch -- many meshes drawn with one indirect call
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/graphics/batch.h"
+#include "kyu/graphics/state.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
+#include "kyu/core/metrics.h"
+#include "kyu/core/profile.h"
+
+#include <string.h>
+
+/* Smallest shared buffers, in vertices and indices */
+#define MIN_VERTICES 4096
+#define MIN_INDICES  (MIN_VERTICES * 3)
+
+static int reserve(void **array, int *capacity, int count, size_t size);
+static GLuint grow_buffer(GLuint buffer, GLsizeiptr used, GLsizeiptr size);
+static void bind_geometry(kyu_batch *batch);
+
+int
+kyu_batch_init(kyu_batch *batch)
+{
+  KYU_ASSERT(batch != NULL, "No batch provided");
+  if (batch == NULL)
+    return -1;
+
+  memset(batch, 0, sizeof(kyu_batch));
+
+  /* Base instances are what the draws read their instance with */
+  if (!GLAD_GL_VERSION_4_2)
+    {
+      KYU_LOG_ERROR("Batches need OpenGL 4.2");
+      return -1;
+    }
+
+  glGenVertexArrays(1, &batch->vao);
+  glGenBuffers(1, &batch->commands_buffer);
+  glGenBuffers(1, &batch->instances_buffer);
+
+  kyu_gl_bind_vertex_array(batch->vao);
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, batch->instances_buffer);
+  kyu_instance_layout();
+  kyu_gl_bind_vertex_array(0);
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+  return 0;
+}
+
+void
+kyu_batch_release(kyu_batch *batch)
+{
+  KYU_ASSERT(batch != NULL, "No batch provided");
+  if (batch == NULL)
+    return;
+
+  kyu_gl_delete_vertex_arrays(1, &batch->vao);
+  kyu_gl_delete_buffers(1, &batch->vbo);
+  kyu_gl_delete_buffers(1, &batch->ibo);
+  kyu_gl_delete_buffers(1, &batch->commands_buffer);
+  kyu_gl_delete_buffers(1, &batch->instances_buffer);
+
+  kyu_free(batch->meshes);
+  kyu_free(batch->commands);
+  kyu_free(batch->instances);
+
+  memset(batch, 0, sizeof(kyu_batch));
+}
+
+int
+kyu_batch_add(kyu_batch *batch, const kyu_mesh *mesh)
+{
+  kyu_mesh_data data;
+  kyu_batch_mesh *slot;
+  GLsizeiptr stride = kyu_vertex_stride(KYU_BATCH_ATTRIBUTES);
+  int capacity;
+
+  KYU_ASSERT(batch != NULL, "No batch provided");
+  KYU_ASSERT(mesh != NULL, "No mesh provided");
+  if (batch == NULL || mesh == NULL || batch->vao == 0)
+    return -1;
+
+  if (reserve((void **)&batch->meshes, &batch->mesh_capacity, batch->nb_meshes + 1,
+              sizeof(kyu_batch_mesh)) != 0)
+    return -1;
+
+  KYU_PROFILE_BEGIN("kyu_batch_add");
+  if (kyu_mesh_data_build(&data, mesh, KYU_BATCH_ATTRIBUTES) != 0)
+    {
+      KYU_PROFILE_END();
+      return -1;
+    }
+
+  /* Grown on the GPU, what was added before is never read back */
+  if (batch->nb_vertices + data.nb_vertices > batch->vertex_capacity)
+    {
+      capacity = MAX(MAX(batch->nb_vertices + data.nb_vertices,
+                         batch->vertex_capacity * 2), MIN_VERTICES);
+      batch->vbo = grow_buffer(batch->vbo, batch->nb_vertices * stride, capacity * stride);
+      batch->vertex_capacity = capacity;
+      bind_geometry(batch);
+    }
+
+  if (batch->nb_indices + data.nb_indices > batch->index_capacity)
+    {
+      capacity = MAX(MAX(batch->nb_indices + data.nb_indices,
+                         batch->index_capacity * 2), MIN_INDICES);
+      batch->ibo = grow_buffer(batch->ibo,
+                               (GLsizeiptr)(batch->nb_indices * sizeof(GLuint)),
+                               (GLsizeiptr)(capacity * sizeof(GLuint)));
+      batch->index_capacity = capacity;
+      bind_geometry(batch);
+    }
+
+  kyu_gl_bind_buffer(GL_COPY_WRITE_BUFFER, batch->vbo);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, batch->nb_vertices * stride,
+                  data.nb_vertices * stride, data.vertices);
+  kyu_gl_bind_buffer(GL_COPY_WRITE_BUFFER, batch->ibo);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)(batch->nb_indices * sizeof(GLuint)),
+                  (GLsizeiptr)(data.nb_indices * sizeof(GLuint)), data.indices);
+  kyu_gl_bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+
+  /* Indices stay relative to the mesh, the base vertex offsets them */
+  slot = &batch->meshes[batch->nb_meshes];
+  slot->first_index = (GLuint)batch->nb_indices;
+  slot->nb_indices  = (GLuint)data.nb_indices;
+  slot->base_vertex = batch->nb_vertices;
+
+  batch->nb_vertices += data.nb_vertices;
+  batch->nb_indices  += data.nb_indices;
+
+  kyu_mesh_data_release(&data);
+  KYU_PROFILE_END();
+
+  return batch->nb_meshes++;
+}
+
+int
+kyu_batch_draw(kyu_batch *batch, int mesh, const kyu_instance *instance)
+{
+  const kyu_batch_mesh *slot;
+  kyu_draw_command *command;
+
+  KYU_ASSERT(batch != NULL, "No batch provided");
+  KYU_ASSERT(instance != NULL, "No instance provided");
+  KYU_ASSERT(batch == NULL || (mesh >= 0 && mesh < batch->nb_meshes), "Bad mesh id");
+  if (batch == NULL || instance == NULL || mesh < 0 || mesh >= batch->nb_meshes)
+    return -1;
+
+  if (reserve((void **)&batch->instances, &batch->instance_capacity,
+              batch->nb_instances + 1, sizeof(kyu_instance)) != 0)
+    return -1;
+
+  slot = &batch->meshes[mesh];
+  command = (batch->nb_commands > 0) ? &batch->commands[batch->nb_commands - 1] : NULL;
+
+  /* Instances are appended in order, the previous command's run goes on */
+  if (command == NULL || command->first_index != slot->first_index
+      || command->base_vertex != slot->base_vertex)
+    {
+      if (reserve((void **)&batch->commands, &batch->command_capacity,
+                  batch->nb_commands + 1, sizeof(kyu_draw_command)) != 0)
+        return -1;
+
+      command = &batch->commands[batch->nb_commands++];
+      command->count          = slot->nb_indices;
+      command->instance_count = 0;
+      command->first_index    = slot->first_index;
+      command->base_vertex    = slot->base_vertex;
+      command->base_instance  = (GLuint)batch->nb_instances;
+    }
+
+  command->instance_count++;
+  batch->instances[batch->nb_instances++] = *instance;
+  batch->triangles += slot->nb_indices / 3;
+
+  return 0;
+}
+
+void
+kyu_batch_submit(kyu_batch *batch)
+{
+  int i;
+
+  KYU_ASSERT(batch != NULL, "No batch provided");
+  if (batch == NULL || batch->nb_commands == 0)
+    return;
+
+  KYU_PROFILE_BEGIN("kyu_batch_submit");
+
+  /* Both are orphaned, the previous frame may still be reading them */
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, batch->instances_buffer);
+  glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(batch->nb_instances * sizeof(kyu_instance)),
+               batch->instances, GL_STREAM_DRAW);
+
+  kyu_gl_bind_vertex_array(batch->vao);
+  if (GLAD_GL_VERSION_4_3)
+    {
+      kyu_gl_bind_buffer(GL_DRAW_INDIRECT_BUFFER, batch->commands_buffer);
+      glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                   (GLsizeiptr)(batch->nb_commands * sizeof(kyu_draw_command)),
+                   batch->commands, GL_STREAM_DRAW);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL,
+                                  batch->nb_commands, 0);
+    }
+  else
+    {
+      for (i = 0; i < batch->nb_commands; ++i)
+        {
+          const kyu_draw_command *command = &batch->commands[i];
+
+          glDrawElementsInstancedBaseVertexBaseInstance(
+            GL_TRIANGLES, (GLsizei)command->count, GL_UNSIGNED_INT,
+            (const GLvoid *)(command->first_index * sizeof(GLuint)),
+            (GLsizei)command->instance_count, command->base_vertex,
+            command->base_instance);
+        }
+    }
+
+  kyu_metrics_draw(batch->triangles);
+
+  batch->nb_commands  = 0;
+  batch->nb_instances = 0;
+  batch->triangles    = 0;
+
+  KYU_PROFILE_END();
+}
+
+static int
+reserve(void **array, int *capacity, int count, size_t size)
+{
+  void *grown;
+  int wanted;
+
+  if (count <= *capacity)
+    return 0;
+
+  wanted = MAX(count, MAX(*capacity * 2, 64));
+  grown = kyu_realloc(*array, wanted * size, KYU_MEMORY_GRAPHICS);
+  KYU_ASSERT(grown != NULL, "Can't grow the batch");
+  if (grown == NULL)
+    return -1;
+
+  *array = grown;
+  *capacity = wanted;
+
+  return 0;
+}
+
+/* A new, larger buffer receives what the old one holds. Meshes are
+   added with glBufferSubData, hence the dynamic usage. */
+static GLuint
+grow_buffer(GLuint buffer, GLsizeiptr used, GLsizeiptr size)
+{
+  GLuint grown;
+
+  glGenBuffers(1, &grown);
+  kyu_gl_bind_buffer(GL_COPY_WRITE_BUFFER, grown);
+  glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+
+  if (used > 0)
+    {
+      kyu_gl_bind_buffer(GL_COPY_READ_BUFFER, buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+      kyu_gl_bind_buffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+  kyu_gl_bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+  if (buffer != 0)
+    kyu_gl_delete_buffers(1, &buffer);
+
+  return grown;
+}
+
+static void
+bind_geometry(kyu_batch *batch)
+{
+  kyu_gl_bind_vertex_array(batch->vao);
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, batch->vbo);
+  kyu_vertex_layout(KYU_BATCH_ATTRIBUTES);
+  kyu_gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, batch->ibo);
+  kyu_gl_bind_vertex_array(0);
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+}
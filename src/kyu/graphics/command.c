@@ -0,0 +1,251 @@
+/* command -- recorded draws submitted in sorted order
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/graphics/command.h"
+#include "kyu/graphics/state.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
+#include "kyu/core/profile.h"
+
+#include <string.h>
+
+/* Key layout, from the most significant bit:
+     opaque       0 | program 12 | material 16 | mesh 16 | depth 19
+     transparent  1 | far depth 24 | program 12 | material 16 | mesh 11 */
+#define FIELD(VALUE, BITS) ((uint64_t)(VALUE) & ((UINT64_C(1) << (BITS)) - 1))
+
+static uint64_t depth_bits(float depth, int bits);
+static int grow(kyu_command_list *list, int count);
+
+uint64_t
+kyu_draw_key(const kyu_draw_packet *packet)
+{
+  GLuint vao = (packet->mesh != NULL) ? packet->mesh->vao : 0;
+
+  if (packet->transparent)
+    return (UINT64_C(1) << 63)
+      | ((FIELD(~depth_bits(packet->depth, 24), 24)) << 39)
+      | (FIELD(packet->program, 12) << 27)
+      | (FIELD(packet->material, 16) << 11)
+      | FIELD(vao, 11);
+
+  return (FIELD(packet->program, 12) << 51)
+    | (FIELD(packet->material, 16) << 35)
+    | (FIELD(vao, 16) << 19)
+    | depth_bits(packet->depth, 19);
+}
+
+int
+kyu_command_list_init(kyu_command_list *list, int capacity)
+{
+  KYU_ASSERT(list != NULL, "No command list provided");
+  if (list == NULL)
+    return -1;
+
+  memset(list, 0, sizeof(kyu_command_list));
+
+  return grow(list, MAX(capacity, 1));
+}
+
+void
+kyu_command_list_release(kyu_command_list *list)
+{
+  KYU_ASSERT(list != NULL, "No command list provided");
+  if (list == NULL)
+    return;
+
+  kyu_free(list->packets);
+  kyu_free(list->keys);
+  kyu_free(list->scratch);
+  memset(list, 0, sizeof(kyu_command_list));
+}
+
+int
+kyu_command_list_record(kyu_command_list *list, const kyu_draw_packet *packet)
+{
+  kyu_command_key *key;
+
+  KYU_ASSERT(list != NULL, "No command list provided");
+  KYU_ASSERT(packet != NULL, "No draw packet provided");
+  if (list == NULL || packet == NULL)
+    return -1;
+
+  if (list->nb_packets == list->capacity && grow(list, list->capacity * 2) != 0)
+    return -1;
+
+  key = &list->keys[list->nb_packets];
+  key->key    = kyu_draw_key(packet);
+  key->packet = list->nb_packets;
+  list->packets[list->nb_packets++] = *packet;
+
+  return 0;
+}
+
+/* LSD radix on bytes, stable so equal keys keep their recording order.
+   A byte every key shares costs only its histogram. */
+void
+kyu_command_list_sort(kyu_command_list *list)
+{
+  int counts[256];
+  kyu_command_key *from, *to, *swap;
+  int i, shift, n, sum;
+
+  KYU_ASSERT(list != NULL, "No command list provided");
+  if (list == NULL || list->nb_packets < 2)
+    return;
+
+  KYU_PROFILE_BEGIN("kyu_command_list_sort");
+  n = list->nb_packets;
+  from = list->keys;
+  to = list->scratch;
+
+  for (shift = 0; shift < 64; shift += 8)
+    {
+      memset(counts, 0, sizeof(counts));
+      for (i = 0; i < n; ++i)
+        counts[(from[i].key >> shift) & 0xff]++;
+
+      if (counts[(from[0].key >> shift) & 0xff] == n)
+        continue;
+
+      for (i = 0, sum = 0; i < 256; ++i)
+        {
+          int count = counts[i];
+
+          counts[i] = sum;
+          sum += count;
+        }
+
+      for (i = 0; i < n; ++i)
+        to[counts[(from[i].key >> shift) & 0xff]++] = from[i];
+
+      swap = from;
+      from = to;
+      to = swap;
+    }
+
+  list->keys = from;
+  list->scratch = to;
+  KYU_PROFILE_END();
+}
+
+int
+kyu_command_list_submit(kyu_command_list *list, const kyu_uniform_ring *uniforms)
+{
+  const kyu_draw_packet *packet, *last = NULL;
+  int i, changes = 0, transparent = -1;
+
+  KYU_ASSERT(list != NULL, "No command list provided");
+  if (list == NULL)
+    return 0;
+
+  kyu_command_list_sort(list);
+
+  KYU_PROFILE_BEGIN("kyu_command_list_submit");
+  for (i = 0; i < list->nb_packets; ++i)
+    {
+      packet = &list->packets[list->keys[i].packet];
+      if (packet->mesh == NULL)
+        continue;
+
+      if (packet->transparent != transparent)
+        {
+          transparent = packet->transparent;
+          if (transparent)
+            {
+              kyu_gl_enable(GL_BLEND);
+              kyu_gl_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+              kyu_gl_depth_mask(GL_FALSE);
+            }
+          else
+            {
+              kyu_gl_disable(GL_BLEND);
+              kyu_gl_depth_mask(GL_TRUE);
+            }
+        }
+
+      if (last == NULL || packet->program != last->program)
+        changes++;
+      if (last == NULL || packet->material != last->material)
+        changes++;
+      if (last == NULL || packet->mesh != last->mesh)
+        changes++;
+
+      kyu_gl_use_program(packet->program);
+      if (uniforms != NULL && packet->material_block >= 0)
+        kyu_uniform_ring_bind(uniforms, KYU_UNIFORM_MATERIAL, packet->material_block,
+                              packet->material_size);
+      if (uniforms != NULL && packet->draw_block >= 0)
+        kyu_uniform_ring_bind(uniforms, KYU_UNIFORM_DRAW, packet->draw_block,
+                              packet->draw_size);
+
+      if (packet->instances != NULL)
+        kyu_instances_draw(packet->instances, packet->mesh);
+      else
+        kyu_gpu_mesh_draw(packet->mesh);
+
+      last = packet;
+    }
+
+  /* Later draws expect the usual opaque state */
+  if (transparent == 1)
+    {
+      kyu_gl_disable(GL_BLEND);
+      kyu_gl_depth_mask(GL_TRUE);
+    }
+
+  list->nb_packets = 0;
+  KYU_PROFILE_END();
+
+  return changes;
+}
+
+static uint64_t
+depth_bits(float depth, int bits)
+{
+  uint64_t max = (UINT64_C(1) << bits) - 1;
+
+  depth = MAX(0.f, MIN(depth, 1.f));
+
+  return (uint64_t)((double)depth * (double)max);
+}
+
+static int
+grow(kyu_command_list *list, int count)
+{
+  kyu_draw_packet *packets;
+  kyu_command_key *keys, *scratch;
+
+  packets = kyu_realloc(list->packets, count * sizeof(kyu_draw_packet), KYU_MEMORY_GRAPHICS);
+  if (packets != NULL)
+    list->packets = packets;
+  keys = kyu_realloc(list->keys, count * sizeof(kyu_command_key), KYU_MEMORY_GRAPHICS);
+  if (keys != NULL)
+    list->keys = keys;
+  scratch = kyu_realloc(list->scratch, count * sizeof(kyu_command_key), KYU_MEMORY_GRAPHICS);
+  if (scratch != NULL)
+    list->scratch = scratch;
+
+  KYU_ASSERT(packets != NULL && keys != NULL && scratch != NULL,
+             "Can't grow the command list");
+  if (packets == NULL || keys == NULL || scratch == NULL)
+    return -1;
+
+  list->capacity = count;
+
+  return 0;
+}
@@ -0,0 +1,352 @@
+/* gpu_mesh -- upload of meshes to OpenGL buffers
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/graphics/gpu_mesh.h"
+#include "kyu/graphics/state.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
+#include "kyu/core/metrics.h"
+#include "kyu/core/profile.h"
+
+#include <string.h>
+
+#define POSITION_SIZE (3 * sizeof(float))
+#define COLOR_SIZE    (4 * sizeof(unsigned char))
+#define NORMAL_SIZE   (3 * sizeof(float))
+#define UV_SIZE       (2 * sizeof(float))
+
+/* Largest vertex count addressable with 16-bit indices */
+#define SHORT_VERTICES 65536
+
+/* Open addressing table from a corner of the OBJ to its vertex */
+typedef struct {
+  int vertex;
+  int normal;
+  int uv;
+  int index;
+} corner;
+
+static unsigned int hash_corner(int vertex, int normal, int uv);
+static void write_vertex(unsigned char *dest, const kyu_mesh *mesh, int attributes,
+                         int vertex, int normal, int uv);
+
+int
+kyu_gpu_mesh_init(kyu_gpu_mesh *gpu, const kyu_mesh *mesh)
+{
+  kyu_mesh_data data;
+  unsigned short *short_indices;
+  size_t index_size;
+  int i;
+
+  KYU_ASSERT(gpu != NULL, "No GPU mesh provided");
+  KYU_ASSERT(mesh != NULL, "No mesh provided");
+  if (gpu == NULL || mesh == NULL)
+    return -1;
+
+  memset(gpu, 0, sizeof(kyu_gpu_mesh));
+
+  KYU_PROFILE_BEGIN("kyu_gpu_mesh_init");
+  if (kyu_mesh_data_build(&data, mesh, kyu_vertex_attributes(mesh)) != 0)
+    {
+      KYU_PROFILE_END();
+      return -1;
+    }
+
+  /* Narrowed in place, each short is written behind the int it reads */
+  if (data.nb_vertices <= SHORT_VERTICES)
+    {
+      short_indices = (unsigned short *)data.indices;
+      for (i = 0; i < data.nb_indices; ++i)
+        short_indices[i] = (unsigned short)data.indices[i];
+
+      gpu->index_type = GL_UNSIGNED_SHORT;
+      index_size = sizeof(unsigned short);
+    }
+  else
+    {
+      gpu->index_type = GL_UNSIGNED_INT;
+      index_size = sizeof(unsigned int);
+    }
+
+  gpu->nb_vertices = data.nb_vertices;
+  gpu->nb_indices  = data.nb_indices;
+  gpu->stride      = data.stride;
+  gpu->attributes  = data.attributes;
+
+  glGenVertexArrays(1, &gpu->vao);
+  glGenBuffers(1, &gpu->vbo);
+  glGenBuffers(1, &gpu->ibo);
+  kyu_gl_bind_vertex_array(gpu->vao);
+
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, gpu->vbo);
+  glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)gpu->nb_vertices * gpu->stride,
+               data.vertices, GL_STATIC_DRAW);
+  kyu_vertex_layout(gpu->attributes);
+
+  kyu_gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, gpu->ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(gpu->nb_indices * index_size),
+               data.indices, GL_STATIC_DRAW);
+
+  kyu_gl_bind_vertex_array(0);
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+  gpu->bytes = (size_t)gpu->nb_vertices * gpu->stride + gpu->nb_indices * index_size;
+
+  kyu_mesh_data_release(&data);
+  KYU_PROFILE_END();
+
+  return 0;
+}
+
+int
+kyu_mesh_data_build(kyu_mesh_data *data, const kyu_mesh *mesh, int attributes)
+{
+  corner *table, *c;
+  unsigned int mask, capacity;
+  int corners, i, j;
+
+  KYU_ASSERT(data != NULL, "No mesh data provided");
+  KYU_ASSERT(mesh != NULL, "No mesh provided");
+  if (data == NULL || mesh == NULL)
+    return -1;
+
+  memset(data, 0, sizeof(kyu_mesh_data));
+  if (mesh->nb_triangles <= 0)
+    {
+      KYU_LOG_WARNING("Can't upload a mesh without triangles");
+      return -1;
+    }
+
+  data->attributes = attributes;
+  data->stride = kyu_vertex_stride(attributes);
+
+  corners = mesh->nb_triangles * 3;
+  for (capacity = 16; capacity < (unsigned int)corners * 2; capacity *= 2)
+    ;
+  mask = capacity - 1;
+
+  table          = kyu_malloc(capacity * sizeof(corner), KYU_MEMORY_GRAPHICS);
+  data->vertices = kyu_malloc((size_t)corners * data->stride, KYU_MEMORY_GRAPHICS);
+  data->indices  = kyu_malloc((size_t)corners * sizeof(unsigned int), KYU_MEMORY_GRAPHICS);
+  KYU_ASSERT(table != NULL && data->vertices != NULL && data->indices != NULL,
+             "Can't allocate memory to build the GPU mesh");
+  if (table == NULL || data->vertices == NULL || data->indices == NULL)
+    goto fail;
+
+  for (i = 0; i < (int)capacity; ++i)
+    table[i].vertex = -1;
+
+  /* One pass: each corner either finds its vertex or appends it */
+  for (i = 0; i < mesh->nb_triangles; ++i)
+    {
+      const kyu_triangle *tri = &mesh->triangles[i];
+
+      for (j = 0; j < 3; ++j)
+        {
+          int vertex = tri->vertices[j];
+          int normal = tri->normals[j];
+          int uv = tri->uvs[j];
+          unsigned int h;
+
+          KYU_ASSERT(vertex >= 0 && vertex < mesh->nb_vertices, "Bad vertex index");
+          if (vertex < 0 || vertex >= mesh->nb_vertices)
+            goto fail;
+
+          if (!(attributes & KYU_GPU_MESH_NORMALS)
+              || normal < 0 || normal >= mesh->nb_normals)
+            normal = -1;
+          if (!(attributes & KYU_GPU_MESH_UVS) || uv < 0 || uv >= mesh->nb_uvs)
+            uv = -1;
+
+          for (h = hash_corner(vertex, normal, uv) & mask; ; h = (h + 1) & mask)
+            {
+              c = &table[h];
+              if (c->vertex == -1)
+                {
+                  c->vertex = vertex;
+                  c->normal = normal;
+                  c->uv     = uv;
+                  c->index  = data->nb_vertices++;
+                  write_vertex(data->vertices + (size_t)c->index * data->stride, mesh,
+                               attributes, vertex, normal, uv);
+                  break;
+                }
+              if (c->vertex == vertex && c->normal == normal && c->uv == uv)
+                break;
+            }
+
+          data->indices[data->nb_indices++] = (unsigned int)c->index;
+        }
+    }
+
+  kyu_free(table);
+
+  return 0;
+
+ fail:
+  kyu_free(table);
+  kyu_mesh_data_release(data);
+
+  return -1;
+}
+
+void
+kyu_mesh_data_release(kyu_mesh_data *data)
+{
+  if (data == NULL)
+    return;
+
+  kyu_free(data->vertices);
+  kyu_free(data->indices);
+  memset(data, 0, sizeof(kyu_mesh_data));
+}
+
+int
+kyu_vertex_attributes(const kyu_mesh *mesh)
+{
+  int attributes = 0;
+
+  if (mesh->colors != NULL && mesh->nb_colors >= mesh->nb_vertices)
+    attributes |= KYU_GPU_MESH_COLORS;
+  if (mesh->nb_normals > 0)
+    attributes |= KYU_GPU_MESH_NORMALS;
+  if (mesh->nb_uvs > 0)
+    attributes |= KYU_GPU_MESH_UVS;
+
+  return attributes;
+}
+
+int
+kyu_vertex_stride(int attributes)
+{
+  return (int)(POSITION_SIZE
+               + ((attributes & KYU_GPU_MESH_COLORS) ? COLOR_SIZE : 0)
+               + ((attributes & KYU_GPU_MESH_NORMALS) ? NORMAL_SIZE : 0)
+               + ((attributes & KYU_GPU_MESH_UVS) ? UV_SIZE : 0));
+}
+
+/* Same order as write_vertex */
+void
+kyu_vertex_layout(int attributes)
+{
+  GLsizei stride = kyu_vertex_stride(attributes);
+  size_t offset = 0;
+
+  glVertexAttribPointer(KYU_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, stride,
+                        (const GLvoid *)offset);
+  glEnableVertexAttribArray(KYU_ATTRIB_POSITION);
+  offset += POSITION_SIZE;
+
+  if (attributes & KYU_GPU_MESH_COLORS)
+    {
+      glVertexAttribPointer(KYU_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                            stride, (const GLvoid *)offset);
+      glEnableVertexAttribArray(KYU_ATTRIB_COLOR);
+      offset += COLOR_SIZE;
+    }
+
+  if (attributes & KYU_GPU_MESH_NORMALS)
+    {
+      glVertexAttribPointer(KYU_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, stride,
+                            (const GLvoid *)offset);
+      glEnableVertexAttribArray(KYU_ATTRIB_NORMAL);
+      offset += NORMAL_SIZE;
+    }
+
+  if (attributes & KYU_GPU_MESH_UVS)
+    {
+      glVertexAttribPointer(KYU_ATTRIB_UV, 2, GL_FLOAT, GL_FALSE, stride,
+                            (const GLvoid *)offset);
+      glEnableVertexAttribArray(KYU_ATTRIB_UV);
+    }
+}
+
+void
+kyu_gpu_mesh_release(kyu_gpu_mesh *gpu)
+{
+  KYU_ASSERT(gpu != NULL, "No GPU mesh provided");
+  if (gpu == NULL)
+    return;
+
+  kyu_gl_delete_vertex_arrays(1, &gpu->vao);
+  kyu_gl_delete_buffers(1, &gpu->vbo);
+  kyu_gl_delete_buffers(1, &gpu->ibo);
+
+  memset(gpu, 0, sizeof(kyu_gpu_mesh));
+}
+
+void
+kyu_gpu_mesh_draw(const kyu_gpu_mesh *gpu)
+{
+  KYU_ASSERT(gpu != NULL, "No GPU mesh provided");
+  if (gpu == NULL || gpu->vao == 0)
+    return;
+
+  kyu_gl_bind_vertex_array(gpu->vao);
+  glDrawElements(GL_TRIANGLES, gpu->nb_indices, gpu->index_type, NULL);
+  kyu_metrics_draw(gpu->nb_indices / 3);
+}
+
+static unsigned int
+hash_corner(int vertex, int normal, int uv)
+{
+  unsigned int h = (unsigned int)vertex * 0x9e3779b1u;
+
+  h ^= (unsigned int)normal * 0x85ebca77u + (h << 6) + (h >> 2);
+  h ^= (unsigned int)uv * 0xc2b2ae3du + (h << 6) + (h >> 2);
+
+  return h;
+}
+
+static void
+write_vertex(unsigned char *dest, const kyu_mesh *mesh, int attributes,
+             int vertex, int normal, int uv)
+{
+  static const float zero[3] = { 0.f, 0.f, 0.f };
+  const kyu_point *p = &mesh->vertices[vertex];
+
+  memcpy(dest, &p->x, POSITION_SIZE);
+  dest += POSITION_SIZE;
+
+  /* Same test as kyu_vertex_attributes, the layout may ask for colors
+     the mesh doesn't have */
+  if ((attributes & KYU_GPU_MESH_COLORS)
+      && (mesh->colors == NULL || mesh->nb_colors < mesh->nb_vertices))
+    {
+      memset(dest, 0xff, COLOR_SIZE);
+      dest += COLOR_SIZE;
+    }
+  else if (attributes & KYU_GPU_MESH_COLORS)
+    {
+      const kyu_color *color = &mesh->colors[vertex];
+
+      dest[0] = (unsigned char)(MAX(0.f, MIN(color->r, 1.f)) * 255.f + 0.5f);
+      dest[1] = (unsigned char)(MAX(0.f, MIN(color->g, 1.f)) * 255.f + 0.5f);
+      dest[2] = (unsigned char)(MAX(0.f, MIN(color->b, 1.f)) * 255.f + 0.5f);
+      dest[3] = (unsigned char)(MAX(0.f, MIN(color->a, 1.f)) * 255.f + 0.5f);
+      dest += COLOR_SIZE;
+    }
+
+  if (attributes & KYU_GPU_MESH_NORMALS)
+    {
+      memcpy(dest, (normal >= 0) ? &mesh->normals[normal].x : zero, NORMAL_SIZE);
+      dest += NORMAL_SIZE;
+    }
+
+  if (attributes & KYU_GPU_MESH_UVS)
+    memcpy(dest, (uv >= 0) ? &mesh->uvs[uv].x : zero, UV_SIZE);
+}
@@ -0,0 +1,173 @@
+/* instance -- instanced drawing of GPU meshes
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/graphics/instance.h"
+#include "kyu/graphics/state.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/metrics.h"
+
+#include <stddef.h>
+#include <string.h>
+
+static void bind_layout(kyu_instances *instances, kyu_gpu_mesh *gpu);
+
+int
+kyu_instances_init(kyu_instances *instances, int capacity)
+{
+  KYU_ASSERT(instances != NULL, "No instance buffer provided");
+  if (instances == NULL)
+    return -1;
+
+  instances->capacity = MAX(capacity, 1);
+  instances->count = 0;
+
+  glGenBuffers(1, &instances->vbo);
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, instances->vbo);
+  glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(instances->capacity * sizeof(kyu_instance)),
+               NULL, GL_STREAM_DRAW);
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+  return 0;
+}
+
+void
+kyu_instances_release(kyu_instances *instances)
+{
+  KYU_ASSERT(instances != NULL, "No instance buffer provided");
+  if (instances == NULL)
+    return;
+
+  kyu_gl_delete_buffers(1, &instances->vbo);
+  memset(instances, 0, sizeof(kyu_instances));
+}
+
+kyu_instance *
+kyu_instances_map(kyu_instances *instances, int count)
+{
+  kyu_instance *data;
+
+  KYU_ASSERT(instances != NULL, "No instance buffer provided");
+  if (instances == NULL || count <= 0)
+    return NULL;
+
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, instances->vbo);
+
+  /* The buffer keeps its name, the VAOs pointing to it stay valid */
+  if (count > instances->capacity)
+    {
+      instances->capacity = MAX(count, instances->capacity * 2);
+      glBufferData(GL_ARRAY_BUFFER,
+                   (GLsizeiptr)(instances->capacity * sizeof(kyu_instance)),
+                   NULL, GL_STREAM_DRAW);
+    }
+
+  data = glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr)(count * sizeof(kyu_instance)),
+                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  KYU_ASSERT(data != NULL, "Can't map the instance buffer");
+
+  instances->count = (data != NULL) ? count : 0;
+
+  return data;
+}
+
+void
+kyu_instances_unmap(kyu_instances *instances)
+{
+  KYU_ASSERT(instances != NULL, "No instance buffer provided");
+  if (instances == NULL)
+    return;
+
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, instances->vbo);
+  if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE)
+    {
+      /* The contents were lost, nothing is drawn this frame */
+      KYU_LOG_WARNING("Instance buffer corrupted while mapped");
+      instances->count = 0;
+    }
+}
+
+void
+kyu_instance_set(kyu_instance *instance, const kyu_matrix *matrix, kyu_color color)
+{
+  int i, j;
+
+  KYU_ASSERT(instance != NULL, "No instance provided");
+  KYU_ASSERT(matrix != NULL && matrix->width == 4 && matrix->height == 4,
+             "Instance matrices are 4x4");
+  if (instance == NULL || matrix == NULL)
+    return;
+
+  for (i = 0; i < 4; ++i)
+    for (j = 0; j < 4; ++j)
+      instance->matrix[j * 4 + i] = matrix->t[i * 4 + j];
+
+  instance->color[0] = color.r;
+  instance->color[1] = color.g;
+  instance->color[2] = color.b;
+  instance->color[3] = color.a;
+}
+
+void
+kyu_instances_draw(kyu_instances *instances, kyu_gpu_mesh *gpu)
+{
+  KYU_ASSERT(instances != NULL, "No instance buffer provided");
+  KYU_ASSERT(gpu != NULL, "No GPU mesh provided");
+  if (instances == NULL || gpu == NULL || gpu->vao == 0 || instances->count == 0)
+    return;
+
+  kyu_gl_bind_vertex_array(gpu->vao);
+  if (gpu->instances != instances->vbo)
+    bind_layout(instances, gpu);
+
+  glDrawElementsInstanced(GL_TRIANGLES, gpu->nb_indices, gpu->index_type, NULL,
+                          instances->count);
+  kyu_metrics_draw((long)instances->count * (gpu->nb_indices / 3));
+}
+
+void
+kyu_instance_layout(void)
+{
+  GLsizei stride = sizeof(kyu_instance);
+  int i;
+
+  for (i = 0; i < 4; ++i)
+    {
+      GLuint location = KYU_ATTRIB_INSTANCE_MATRIX + i;
+
+      glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride,
+                            (const GLvoid *)(offsetof(kyu_instance, matrix)
+                                             + i * 4 * sizeof(float)));
+      glVertexAttribDivisor(location, 1);
+      glEnableVertexAttribArray(location);
+    }
+
+  glVertexAttribPointer(KYU_ATTRIB_INSTANCE_COLOR, 4, GL_FLOAT, GL_FALSE, stride,
+                        (const GLvoid *)offsetof(kyu_instance, color));
+  glVertexAttribDivisor(KYU_ATTRIB_INSTANCE_COLOR, 1);
+  glEnableVertexAttribArray(KYU_ATTRIB_INSTANCE_COLOR);
+}
+
+/* Kept by the VAO until another instance buffer is drawn with the mesh */
+static void
+bind_layout(kyu_instances *instances, kyu_gpu_mesh *gpu)
+{
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, instances->vbo);
+  kyu_instance_layout();
+  kyu_gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+  gpu->instances = instances->vbo;
+}
@@ -23,7 +23,9 @@
 #include <ctype.h>
 
 #include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
 #include "kyu/core/file.h"
+#include "kyu/core/profile.h"
 
 #define LINE_LENGTH 1024
 
@@ -33,13 +35,15 @@
     if ((SIZE) >= (CAPACITY))                                               \
       {                                                                     \
         int new_capacity = (CAPACITY) * 2;                                  \
-        (ARR) = realloc((ARR), new_capacity * sizeof((ARR)[0]));            \
+        (ARR) = kyu_realloc((ARR), new_capacity * sizeof((ARR)[0]),         \
+                            KYU_MEMORY_MESH);                               \
         (CAPACITY) = new_capacity;                                          \
                                                                             \
         KYU_ASSERT((ARR) != NULL, "Failed to realloc memory for an array"); \
       }                                                                     \
   }
-#define SHRINK_ARRAY(ARR, SIZE) ((ARR) = realloc((ARR), (SIZE) * sizeof((ARR)[0])))
+#define SHRINK_ARRAY(ARR, SIZE) \
+  ((ARR) = kyu_realloc((ARR), (SIZE) * sizeof((ARR)[0]), KYU_MEMORY_MESH))
 
 static const char *wavefront_skip[] = {
   "#",
@@ -81,16 +85,20 @@ kyu_mesh_read(const char *restrict filename)
   char *ptr;
 
   KYU_ASSERT(filename != NULL, "No filename provided");
-  
+
+  KYU_PROFILE_BEGIN("kyu_mesh_read");
   if ((file = kyu_open_file(filename, "r")) == NULL)
-    return NULL;
+    {
+      KYU_PROFILE_END();
+      return NULL;
+    }
 
-  mesh = (kyu_mesh *)malloc(sizeof(kyu_mesh));
+  mesh = (kyu_mesh *)kyu_malloc(sizeof(kyu_mesh), KYU_MEMORY_MESH);
 
-  mesh->vertices       = (kyu_point *)malloc(3 * sizeof(kyu_point));
-  mesh->normals        = (kyu_vec *)malloc(3 * sizeof(kyu_vec));
-  mesh->uvs            = (kyu_vec2 *)malloc(3 * sizeof(kyu_vec2));
-  mesh->triangles      = (kyu_triangle *)malloc(sizeof(kyu_triangle));
+  mesh->vertices       = (kyu_point *)kyu_malloc(3 * sizeof(kyu_point), KYU_MEMORY_MESH);
+  mesh->normals        = (kyu_vec *)kyu_malloc(3 * sizeof(kyu_vec), KYU_MEMORY_MESH);
+  mesh->uvs            = (kyu_vec2 *)kyu_malloc(3 * sizeof(kyu_vec2), KYU_MEMORY_MESH);
+  mesh->triangles      = (kyu_triangle *)kyu_malloc(sizeof(kyu_triangle), KYU_MEMORY_MESH);
   mesh->colors         = NULL;
   
   mesh->nb_vertices    = 0;
@@ -160,6 +168,7 @@ kyu_mesh_read(const char *restrict filename)
   SHRINK_ARRAY(mesh->triangles, mesh->nb_triangles);
   
   kyu_close_file(file);
+  KYU_PROFILE_END();
   return mesh;
 }
 
@@ -170,12 +179,12 @@ kyu_mesh_release(kyu_mesh *mesh)
   
   if (mesh != NULL)
     {
-      free(mesh->vertices);
-      free(mesh->normals);
-      free(mesh->uvs);
-      free(mesh->triangles);
-      free(mesh->colors);
-      free(mesh);
+      kyu_free(mesh->vertices);
+      kyu_free(mesh->normals);
+      kyu_free(mesh->uvs);
+      kyu_free(mesh->triangles);
+      kyu_free(mesh->colors);
+      kyu_free(mesh);
     }
 }
 
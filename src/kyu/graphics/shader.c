@@ -15,63 +15,114 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
 
+#if defined(__unix__) || defined(__unix) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "kyu/core/utils.h"
 #include "kyu/core/file.h"
+#include "kyu/core/memory.h"
+#include "kyu/core/profile.h"
 #include "kyu/graphics/shader.h"
+#include "kyu/graphics/state.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __KYU_WIN__
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
 #define INFO_SIZE 512
 
+#define BINARY_MAGIC   0x4b595542u /* "KYUB" */
+#define BINARY_VERSION 1
+
+/* The cache directory, then "/" and 16 hex digits and ".bin" */
+#define BINARY_PATH_SIZE (sizeof(cache_directory) + 22)
+
 static const char *VERTEX_SHADER = "Vertex";
 static const char *FRAGMENT_SHADER = "Fragment";
 
-GLuint
-read_shaders(const char *restrict vertex_file,
-             const char *restrict fragment_file)
-{
-  GLuint prog;
-  int vertex_shader, fragment_shader;
-  int success;
-  char info[INFO_SIZE];
+/* Written in front of each program binary */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t format;
+  uint32_t length;
+  uint64_t key;
+} binary_header;
 
-  vertex_shader = create_shader(vertex_file, GL_VERTEX_SHADER);
-  fragment_shader = create_shader(fragment_file, GL_FRAGMENT_SHADER);
-  
-  prog = glCreateProgram();
+#define STAGE_COMPILING 1
+#define STAGE_LINKING   2
 
-  if (vertex_shader > 0)
-    glAttachShader(prog, vertex_shader);
+static char cache_directory[256];
 
-  if (fragment_shader > 0)
-    glAttachShader(prog, fragment_shader);
-  
-  glLinkProgram(prog);
-  glGetProgramiv(prog, GL_LINK_STATUS, &success);
-  if (!success)
+/* Whether the driver reports completion without blocking */
+static int parallel = 0;
+static int parallel_checked = 0;
+
+static kyu_program_status advance(kyu_program *program, int blocking);
+static GLuint compile_shader(const char *source, const GLenum type);
+static int check_shader(GLuint shader, const GLenum type);
+static int binaries_supported(void);
+static uint64_t hash_string(uint64_t h, const char *text);
+static uint64_t hash_program(const char *vertex_source, const char *fragment_source);
+static int binary_path(char *path, size_t size, uint64_t key);
+static GLuint load_binary(uint64_t key);
+static void save_binary(GLuint prog, uint64_t key);
+
+int
+kyu_set_shader_cache(const char *directory)
+{
+  if (directory == NULL)
+    {
+      cache_directory[0] = '\0';
+      return 0;
+    }
+
+  if (strlen(directory) >= sizeof(cache_directory) - 32)
     {
-      glGetProgramInfoLog(prog, INFO_SIZE, NULL, info);
-      KYU_LOG(GL_ERROR, "Program linking failed\n\t%s\n", info);
+      KYU_LOG_WARNING("Shader cache path too long: %s", directory);
+      return -1;
     }
 
-  if (vertex_shader)
-    glDeleteShader(vertex_shader);
+  /* Fails when the directory exists, opening a file in it tells */
+#ifdef __KYU_WIN__
+  _mkdir(directory);
+#else
+  mkdir(directory, 0755);
+#endif
 
-  if (fragment_shader)
-    glDeleteShader(fragment_shader);
+  strcpy(cache_directory, directory);
 
-  return prog;
+  return 0;
+}
+
+GLuint
+read_shaders(const char *restrict vertex_file,
+             const char *restrict fragment_file)
+{
+  kyu_program program;
+
+  KYU_PROFILE_BEGIN("read_shaders");
+  kyu_program_submit(&program, vertex_file, fragment_file);
+  kyu_program_wait(&program);
+  KYU_PROFILE_END();
+
+  return program.program;
 }
 
 int
 create_shader(const char *filename, const GLuint type)
 {
-  int shader, success;
+  int shader;
   kyu_file *file;
-  char info[INFO_SIZE];
-  char *current_type, *buffer;
+  char *buffer;
 
   if (filename == NULL)
     return -1;
@@ -83,7 +134,236 @@ create_shader(const char *filename, const GLuint type)
     }
 
   kyu_mmap_file(&buffer, file);
+  shader = (int)compile_shader(buffer, type);
+  check_shader(shader, type);
+  kyu_unmap_file(&buffer, file);
+  kyu_close_file(file);
   
+  return shader;
+}
+
+int
+kyu_program_submit(kyu_program *program, const char *vertex_file,
+                   const char *fragment_file)
+{
+  kyu_file *vertex = NULL, *fragment = NULL;
+  char *vertex_source = NULL, *fragment_source = NULL;
+
+  KYU_ASSERT(program != NULL, "No program provided");
+  if (program == NULL)
+    return -1;
+
+  memset(program, 0, sizeof(kyu_program));
+  program->status = KYU_PROGRAM_PENDING;
+
+  /* The driver picks its thread count, once per context is enough */
+  if (!parallel_checked)
+    {
+      parallel = GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile;
+      if (GLAD_GL_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xffffffffu);
+      else if (GLAD_GL_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xffffffffu);
+      parallel_checked = 1;
+    }
+
+  if (vertex_file != NULL && (vertex = kyu_open_file(vertex_file, "r")) != NULL)
+    kyu_mmap_file(&vertex_source, vertex);
+  if (fragment_file != NULL && (fragment = kyu_open_file(fragment_file, "r")) != NULL)
+    kyu_mmap_file(&fragment_source, fragment);
+
+  if (vertex_file != NULL && vertex == NULL)
+    KYU_LOG_ERROR("Failed to open the file \"%s\", exiting", vertex_file);
+  if (fragment_file != NULL && fragment == NULL)
+    KYU_LOG_ERROR("Failed to open the file \"%s\", exiting", fragment_file);
+
+  /* Only complete programs are cached */
+  program->cached = cache_directory[0] != '\0' && vertex_source != NULL
+    && fragment_source != NULL && binaries_supported();
+  if (program->cached)
+    {
+      program->key = hash_program(vertex_source, fragment_source);
+      program->program = load_binary(program->key);
+    }
+
+  if (program->program != 0)
+    {
+      kyu_gl_cache_uniforms(program->program);
+      program->status = KYU_PROGRAM_READY;
+    }
+  else if (vertex_source == NULL || fragment_source == NULL)
+    program->status = KYU_PROGRAM_FAILED;
+  else
+    {
+      /* Nothing is queried here, the driver compiles while we go on */
+      program->vertex_shader = compile_shader(vertex_source, GL_VERTEX_SHADER);
+      program->fragment_shader = compile_shader(fragment_source, GL_FRAGMENT_SHADER);
+      program->program = glCreateProgram();
+      if (program->cached)
+        glProgramParameteri(program->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+      program->stage = STAGE_COMPILING;
+    }
+
+  if (vertex != NULL)
+    {
+      kyu_unmap_file(&vertex_source, vertex);
+      kyu_close_file(vertex);
+    }
+  if (fragment != NULL)
+    {
+      kyu_unmap_file(&fragment_source, fragment);
+      kyu_close_file(fragment);
+    }
+
+  return (program->status == KYU_PROGRAM_FAILED) ? -1 : 0;
+}
+
+kyu_program_status
+kyu_program_poll(kyu_program *program)
+{
+  KYU_ASSERT(program != NULL, "No program provided");
+  if (program == NULL)
+    return KYU_PROGRAM_FAILED;
+
+  return advance(program, 0);
+}
+
+kyu_program_status
+kyu_program_wait(kyu_program *program)
+{
+  KYU_ASSERT(program != NULL, "No program provided");
+  KYU_ASSERT(program == NULL || program->status != KYU_PROGRAM_IDLE,
+             "Program waited on before being submitted");
+  if (program == NULL)
+    return KYU_PROGRAM_FAILED;
+
+  while (program->status == KYU_PROGRAM_PENDING)
+    advance(program, 1);
+
+  return program->status;
+}
+
+int
+kyu_programs_poll(kyu_program *programs, int count)
+{
+  int i, pending = 0;
+
+  for (i = 0; i < count; ++i)
+    if (kyu_program_poll(&programs[i]) == KYU_PROGRAM_PENDING)
+      pending++;
+
+  return pending;
+}
+
+/* One stage per call. Without KHR_parallel_shader_compile, status
+   queries are what blocks: they wait for the next poll so that every
+   submitted program is in the driver's hands first. */
+static kyu_program_status
+advance(kyu_program *program, int blocking)
+{
+  GLint done = GL_TRUE, success;
+  char info[INFO_SIZE];
+  int compiled;
+
+  if (program->status != KYU_PROGRAM_PENDING)
+    return program->status;
+
+  switch (program->stage)
+    {
+    case STAGE_COMPILING:
+      if (parallel && !blocking)
+        {
+          glGetShaderiv(program->vertex_shader, GL_COMPLETION_STATUS_KHR, &done);
+          if (done)
+            glGetShaderiv(program->fragment_shader, GL_COMPLETION_STATUS_KHR, &done);
+          if (!done)
+            break;
+        }
+
+      compiled = check_shader(program->vertex_shader, GL_VERTEX_SHADER);
+      compiled = check_shader(program->fragment_shader, GL_FRAGMENT_SHADER) && compiled;
+      if (compiled)
+        {
+          glAttachShader(program->program, program->vertex_shader);
+          glAttachShader(program->program, program->fragment_shader);
+          glLinkProgram(program->program);
+        }
+
+      /* Attached shaders live on until the program is deleted */
+      glDeleteShader(program->vertex_shader);
+      glDeleteShader(program->fragment_shader);
+      program->vertex_shader = 0;
+      program->fragment_shader = 0;
+
+      if (!compiled)
+        {
+          glDeleteProgram(program->program);
+          program->program = 0;
+          program->status = KYU_PROGRAM_FAILED;
+          break;
+        }
+
+      program->stage = STAGE_LINKING;
+      if (!parallel && !blocking)
+        break;
+      /* FALLTHROUGH */
+
+    case STAGE_LINKING:
+      if (parallel && !blocking)
+        {
+          glGetProgramiv(program->program, GL_COMPLETION_STATUS_KHR, &done);
+          if (!done)
+            break;
+        }
+
+      glGetProgramiv(program->program, GL_LINK_STATUS, &success);
+      if (!success)
+        {
+          glGetProgramInfoLog(program->program, INFO_SIZE, NULL, info);
+          KYU_LOG(GL_ERROR, "Program linking failed\n\t%s\n", info);
+          glDeleteProgram(program->program);
+          program->program = 0;
+          program->status = KYU_PROGRAM_FAILED;
+          break;
+        }
+
+      if (program->cached)
+        save_binary(program->program, program->key);
+      kyu_gl_cache_uniforms(program->program);
+      program->status = KYU_PROGRAM_READY;
+      break;
+
+    default:
+      break;
+    }
+
+  return program->status;
+}
+
+/* Only issues the compile, check_shader reads the result */
+static GLuint
+compile_shader(const char *source, const GLenum type)
+{
+  GLuint shader;
+
+  shader = glCreateShader(type);
+  glShaderSource(shader, 1, (const GLchar * const*) &source, NULL);
+  glCompileShader(shader);
+
+  return shader;
+}
+
+static int
+check_shader(GLuint shader, const GLenum type)
+{
+  GLint success;
+  char info[INFO_SIZE];
+  char *current_type;
+
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (success)
+    return 1;
+
   switch (type)
     {
     case GL_VERTEX_SHADER:
@@ -97,21 +377,159 @@ create_shader(const char *filename, const GLuint type)
     default:
       current_type = "\0";
     }
-  
-  shader = glCreateShader(type);
-  glShaderSource(shader, 1, (const GLchar * const*) &buffer, NULL);
-  glCompileShader(shader);
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-  if (!success)
+
+  glGetShaderInfoLog(shader, INFO_SIZE, NULL, info);
+  KYU_LOG(GL_ERROR,
+          "\"%s\" shader compilation failed\n\t%s",
+          current_type, info);
+
+  return 0;
+}
+
+static int
+binaries_supported(void)
+{
+  GLint formats = 0;
+
+  if (!GLAD_GL_VERSION_4_1 && !GLAD_GL_ARB_get_program_binary)
+    return 0;
+
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+  return formats > 0;
+}
+
+/* 64-bit FNV-1a */
+static uint64_t
+hash_string(uint64_t h, const char *text)
+{
+  if (text == NULL)
+    return h;
+
+  for (; *text != '\0'; ++text)
+    h = (h ^ (unsigned char)*text) * UINT64_C(0x100000001b3);
+
+  /* Keeps "ab" + "c" apart from "a" + "bc" */
+  return (h ^ 0xff) * UINT64_C(0x100000001b3);
+}
+
+/* A driver update changes the version string, its binaries are rejected
+   anyway but would never be overwritten otherwise */
+static uint64_t
+hash_program(const char *vertex_source, const char *fragment_source)
+{
+  uint64_t h = UINT64_C(0xcbf29ce484222325);
+
+  h = hash_string(h, vertex_source);
+  h = hash_string(h, fragment_source);
+  h = hash_string(h, (const char *)glGetString(GL_VENDOR));
+  h = hash_string(h, (const char *)glGetString(GL_RENDERER));
+  h = hash_string(h, (const char *)glGetString(GL_VERSION));
+
+  return h;
+}
+
+/* Returns -1 when the path doesn't fit, the cache is skipped then */
+static int
+binary_path(char *path, size_t size, uint64_t key)
+{
+  int length;
+
+  length = snprintf(path, size, "%s/%08lx%08lx.bin", cache_directory,
+                    (unsigned long)(key >> 32), (unsigned long)(key & 0xffffffffu));
+
+  return (length < 0 || (size_t)length >= size) ? -1 : 0;
+}
+
+static GLuint
+load_binary(uint64_t key)
+{
+  char path[BINARY_PATH_SIZE];
+  binary_header header;
+  GLuint prog = 0;
+  GLint success = 0;
+  FILE *file;
+  void *data;
+
+  if (binary_path(path, sizeof(path), key) != 0 || (file = fopen(path, "rb")) == NULL)
+    return 0;
+
+  if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != BINARY_MAGIC
+      || header.version != BINARY_VERSION || header.key != key || header.length == 0)
     {
-      glGetShaderInfoLog(shader, INFO_SIZE, NULL, info);
-      KYU_LOG(GL_ERROR,
-              "\"%s\" shader compilation failed\n\t%s",
-              current_type, info);
+      fclose(file);
+      return 0;
     }
 
-  kyu_unmap_file(&buffer, file);
-  kyu_close_file(file);
-  
-  return shader;
+  data = kyu_malloc(header.length, KYU_MEMORY_GRAPHICS);
+  if (data != NULL && fread(data, header.length, 1, file) == 1)
+    {
+      prog = glCreateProgram();
+      glProgramBinary(prog, header.format, data, (GLsizei)header.length);
+      glGetProgramiv(prog, GL_LINK_STATUS, &success);
+    }
+
+  fclose(file);
+  kyu_free(data);
+
+  /* Rejected, the source compile replaces it */
+  if (prog != 0 && !success)
+    {
+      glDeleteProgram(prog);
+      prog = 0;
+    }
+
+  return prog;
+}
+
+static void
+save_binary(GLuint prog, uint64_t key)
+{
+  char path[BINARY_PATH_SIZE], temporary[BINARY_PATH_SIZE + 4];
+  binary_header header;
+  GLint length = 0;
+  GLenum format;
+  FILE *file;
+  void *data;
+  int written;
+
+  if (binary_path(path, sizeof(path), key) != 0)
+    return;
+
+  glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+
+  data = kyu_malloc((size_t)length, KYU_MEMORY_GRAPHICS);
+  if (data == NULL)
+    return;
+
+  glGetProgramBinary(prog, length, &length, &format, data);
+
+  header.magic   = BINARY_MAGIC;
+  header.version = BINARY_VERSION;
+  header.format  = (uint32_t)format;
+  header.length  = (uint32_t)length;
+  header.key     = key;
+
+  /* Renamed once complete, a crash never leaves half a binary behind */
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  if ((file = fopen(temporary, "wb")) == NULL)
+    {
+      KYU_LOG_WARNING("Can't write to the shader cache %s", cache_directory);
+      kyu_free(data);
+      return;
+    }
+
+  written = fwrite(&header, sizeof(header), 1, file) == 1
+    && fwrite(data, (size_t)length, 1, file) == 1;
+  written = (fclose(file) == 0) && written;
+  kyu_free(data);
+
+  /* rename replaces the file atomically on POSIX, not on Windows */
+#ifdef __KYU_WIN__
+  remove(path);
+#endif
+  if (!written || rename(temporary, path) != 0)
+    remove(temporary);
 }
@@ -0,0 +1,538 @@
+/* state -- cached OpenGL bindings and uniform locations
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/graphics/state.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
+
+#include <string.h>
+
+/* Never a name the driver returns, the next call goes through */
+#define UNKNOWN ((GLuint)-1)
+
+#define BUFFER_TARGETS 8
+#define CAPABILITIES   5
+
+static const GLenum buffer_targets[BUFFER_TARGETS] = {
+  GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_COPY_READ_BUFFER,
+  GL_COPY_WRITE_BUFFER, GL_DRAW_INDIRECT_BUFFER, GL_UNIFORM_BUFFER,
+  GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER
+};
+
+static const GLenum capabilities[CAPABILITIES] = {
+  GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST
+};
+
+static struct {
+  int valid;
+
+  GLuint program;
+  GLuint vao;
+  GLuint buffers[BUFFER_TARGETS];
+
+  /* Indexed GL_UNIFORM_BUFFER bindings */
+  GLuint ranges[KYU_GL_UNIFORM_BINDINGS];
+  GLintptr range_offsets[KYU_GL_UNIFORM_BINDINGS];
+  GLsizeiptr range_sizes[KYU_GL_UNIFORM_BINDINGS];
+
+  GLuint unit;
+  GLuint textures[KYU_GL_TEXTURE_UNITS];
+  GLenum texture_targets[KYU_GL_TEXTURE_UNITS];
+
+  /* 1 enabled, 0 disabled, -1 unknown */
+  int enabled[CAPABILITIES];
+  GLenum blend_source;
+  GLenum blend_destination;
+  GLenum depth_func;
+  int depth_mask;
+} state;
+
+/* Open addressing on the program and the name, a free slot has no program */
+typedef struct {
+  GLuint program;
+  GLint location;
+  unsigned long hash;
+  char name[KYU_GL_UNIFORM_NAME];
+} uniform;
+
+static uniform *uniforms = NULL;
+static unsigned long uniform_capacity = 0;
+static unsigned long nb_uniforms = 0;
+
+static int buffer_index(GLenum target);
+static int capability_index(GLenum cap);
+static void set_capability(GLenum cap, int enabled);
+static unsigned long hash_uniform(GLuint program, const char *name);
+static uniform *find_uniform(GLuint program, const char *name, unsigned long hash);
+static void add_uniform(GLuint program, const char *name, GLint location);
+static void place_uniform(const uniform *u);
+static void remove_uniforms(GLuint program);
+
+void
+kyu_gl_state_reset(void)
+{
+  int i;
+
+  state.program = UNKNOWN;
+  state.vao     = UNKNOWN;
+  for (i = 0; i < BUFFER_TARGETS; ++i)
+    state.buffers[i] = UNKNOWN;
+  for (i = 0; i < KYU_GL_UNIFORM_BINDINGS; ++i)
+    state.ranges[i] = UNKNOWN;
+
+  state.unit = UNKNOWN;
+  for (i = 0; i < KYU_GL_TEXTURE_UNITS; ++i)
+    {
+      state.textures[i] = UNKNOWN;
+      state.texture_targets[i] = GL_NONE;
+    }
+
+  for (i = 0; i < CAPABILITIES; ++i)
+    state.enabled[i] = -1;
+  state.blend_source      = GL_NONE;
+  state.blend_destination = GL_NONE;
+  state.depth_func        = GL_NONE;
+  state.depth_mask        = -1;
+
+  state.valid = 1;
+}
+
+void
+kyu_gl_use_program(GLuint program)
+{
+  if (!state.valid)
+    kyu_gl_state_reset();
+
+  if (state.program != program)
+    {
+      glUseProgram(program);
+      state.program = program;
+    }
+}
+
+void
+kyu_gl_bind_vertex_array(GLuint vao)
+{
+  if (!state.valid)
+    kyu_gl_state_reset();
+
+  if (state.vao != vao)
+    {
+      glBindVertexArray(vao);
+      state.vao = vao;
+
+      /* The element buffer binding belongs to the VAO */
+      state.buffers[buffer_index(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+    }
+}
+
+void
+kyu_gl_bind_buffer(GLenum target, GLuint buffer)
+{
+  int i = buffer_index(target);
+
+  if (!state.valid)
+    kyu_gl_state_reset();
+
+  if (i < 0)
+    glBindBuffer(target, buffer);
+  else if (state.buffers[i] != buffer)
+    {
+      glBindBuffer(target, buffer);
+      state.buffers[i] = buffer;
+    }
+}
+
+void
+kyu_gl_bind_buffer_range(GLenum target, GLuint index, GLuint buffer,
+                         GLintptr offset, GLsizeiptr size)
+{
+  int cached = (target == GL_UNIFORM_BUFFER && index < KYU_GL_UNIFORM_BINDINGS);
+
+  if (!state.valid)
+    kyu_gl_state_reset();
+
+  if (cached && state.ranges[index] == buffer && state.range_offsets[index] == offset
+      && state.range_sizes[index] == size)
+    return;
+
+  glBindBufferRange(target, index, buffer, offset, size);
+  if (buffer_index(target) >= 0)
+    state.buffers[buffer_index(target)] = buffer;
+
+  if (cached)
+    {
+      state.ranges[index] = buffer;
+      state.range_offsets[index] = offset;
+      state.range_sizes[index] = size;
+    }
+}
+
+void
+kyu_gl_bind_texture(GLuint unit, GLenum target, GLuint texture)
+{
+  if (!state.valid)
+    kyu_gl_state_reset();
+
+  if (unit < KYU_GL_TEXTURE_UNITS && state.textures[unit] == texture
+      && state.texture_targets[unit] == target)
+    return;
+
+  if (state.unit != unit)
+    {
+      glActiveTexture(GL_TEXTURE0 + unit);
+      state.unit = unit;
+    }
+
+  glBindTexture(target, texture);
+  if (unit < KYU_GL_TEXTURE_UNITS)
+    {
+      state.textures[unit] = texture;
+      state.texture_targets[unit] = target;
+    }
+}
+
+void
+kyu_gl_enable(GLenum cap)
+{
+  set_capability(cap, 1);
+}
+
+void
+kyu_gl_disable(GLenum cap)
+{
+  set_capability(cap, 0);
+}
+
+void
+kyu_gl_blend_func(GLenum source, GLenum destination)
+{
+  if (!state.valid)
+    kyu_gl_state_reset();
+
+  if (state.blend_source != source || state.blend_destination != destination)
+    {
+      glBlendFunc(source, destination);
+      state.blend_source = source;
+      state.blend_destination = destination;
+    }
+}
+
+void
+kyu_gl_depth_func(GLenum func)
+{
+  if (!state.valid)
+    kyu_gl_state_reset();
+
+  if (state.depth_func != func)
+    {
+      glDepthFunc(func);
+      state.depth_func = func;
+    }
+}
+
+void
+kyu_gl_depth_mask(GLboolean write)
+{
+  if (!state.valid)
+    kyu_gl_state_reset();
+
+  if (state.depth_mask != (write != GL_FALSE))
+    {
+      glDepthMask(write);
+      state.depth_mask = (write != GL_FALSE);
+    }
+}
+
+/* A program in use lives on until another one replaces it, the binding
+   stays right */
+void
+kyu_gl_delete_program(GLuint program)
+{
+  if (program == 0)
+    return;
+
+  remove_uniforms(program);
+  glDeleteProgram(program);
+}
+
+void
+kyu_gl_delete_vertex_arrays(GLsizei n, const GLuint *vaos)
+{
+  GLsizei i;
+
+  for (i = 0; i < n; ++i)
+    if (vaos[i] != 0 && vaos[i] == state.vao)
+      {
+        state.vao = 0;
+        state.buffers[buffer_index(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+      }
+
+  glDeleteVertexArrays(n, vaos);
+}
+
+void
+kyu_gl_delete_buffers(GLsizei n, const GLuint *buffers)
+{
+  GLsizei i;
+  int j;
+
+  for (i = 0; i < n; ++i)
+    for (j = 0; j < BUFFER_TARGETS; ++j)
+      if (buffers[i] != 0 && state.buffers[j] == buffers[i])
+        state.buffers[j] = 0;
+
+  for (i = 0; i < n; ++i)
+    for (j = 0; j < KYU_GL_UNIFORM_BINDINGS; ++j)
+      if (buffers[i] != 0 && state.ranges[j] == buffers[i])
+        state.ranges[j] = 0;
+
+  glDeleteBuffers(n, buffers);
+}
+
+void
+kyu_gl_delete_textures(GLsizei n, const GLuint *textures)
+{
+  GLsizei i;
+  int j;
+
+  for (i = 0; i < n; ++i)
+    for (j = 0; j < KYU_GL_TEXTURE_UNITS; ++j)
+      if (textures[i] != 0 && state.textures[j] == textures[i])
+        state.textures[j] = 0;
+
+  glDeleteTextures(n, textures);
+}
+
+void
+kyu_gl_cache_uniforms(GLuint program)
+{
+  char name[KYU_GL_UNIFORM_NAME];
+  GLint count = 0, i;
+  GLsizei length;
+  GLint size;
+  GLenum type;
+
+  /* 0 marks the free slots, and is what a failed link gives */
+  if (program == 0)
+    return;
+
+  remove_uniforms(program);
+
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+  for (i = 0; i < count; ++i)
+    {
+      glGetActiveUniform(program, (GLuint)i, sizeof(name), &length, &size, &type, name);
+      if (length <= 0 || length >= KYU_GL_UNIFORM_NAME - 1)
+        continue;
+
+      add_uniform(program, name, glGetUniformLocation(program, name));
+
+      /* Arrays are listed as "name[0]", they are also found as "name" */
+      if (length > 3 && strcmp(name + length - 3, "[0]") == 0)
+        {
+          name[length - 3] = '\0';
+          add_uniform(program, name, glGetUniformLocation(program, name));
+        }
+    }
+}
+
+GLint
+kyu_gl_uniform_location(GLuint program, const char *name)
+{
+  uniform *u;
+  GLint location;
+
+  KYU_ASSERT(name != NULL, "No uniform name provided");
+  if (name == NULL || program == 0)
+    return -1;
+
+  u = find_uniform(program, name, hash_uniform(program, name));
+  if (u != NULL)
+    return u->location;
+
+  /* Unused uniforms are cached too, at -1 */
+  location = glGetUniformLocation(program, name);
+  if (strlen(name) < KYU_GL_UNIFORM_NAME)
+    add_uniform(program, name, location);
+
+  return location;
+}
+
+static int
+buffer_index(GLenum target)
+{
+  int i;
+
+  for (i = 0; i < BUFFER_TARGETS; ++i)
+    if (buffer_targets[i] == target)
+      return i;
+
+  return -1;
+}
+
+static int
+capability_index(GLenum cap)
+{
+  int i;
+
+  for (i = 0; i < CAPABILITIES; ++i)
+    if (capabilities[i] == cap)
+      return i;
+
+  return -1;
+}
+
+static void
+set_capability(GLenum cap, int enabled)
+{
+  int i = capability_index(cap);
+
+  if (!state.valid)
+    kyu_gl_state_reset();
+
+  if (i >= 0 && state.enabled[i] == enabled)
+    return;
+
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+
+  if (i >= 0)
+    state.enabled[i] = enabled;
+}
+
+/* FNV-1a of the name, mixed with the program */
+static unsigned long
+hash_uniform(GLuint program, const char *name)
+{
+  unsigned long h = 2166136261ul ^ ((unsigned long)program * 0x9e3779b1ul);
+
+  for (; *name != '\0'; ++name)
+    h = ((h ^ (unsigned char)*name) * 16777619ul) & 0xfffffffful;
+
+  return h;
+}
+
+static uniform *
+find_uniform(GLuint program, const char *name, unsigned long hash)
+{
+  unsigned long i, mask = uniform_capacity - 1;
+
+  if (uniforms == NULL)
+    return NULL;
+
+  for (i = hash & mask; uniforms[i].program != 0; i = (i + 1) & mask)
+    if (uniforms[i].program == program && uniforms[i].hash == hash
+        && strcmp(uniforms[i].name, name) == 0)
+      return &uniforms[i];
+
+  return NULL;
+}
+
+static void
+add_uniform(GLuint program, const char *name, GLint location)
+{
+  uniform *old = uniforms, *u, added;
+  unsigned long old_capacity = uniform_capacity, hash, i;
+
+  if (program == 0)
+    return;
+
+  hash = hash_uniform(program, name);
+  if ((u = find_uniform(program, name, hash)) != NULL)
+    {
+      u->location = location;
+      return;
+    }
+
+  /* Half full at most, the probes stay short */
+  if ((nb_uniforms + 1) * 2 > uniform_capacity)
+    {
+      uniform_capacity = (old_capacity > 0) ? old_capacity * 2 : 64;
+      uniforms = kyu_calloc(uniform_capacity, sizeof(uniform), KYU_MEMORY_GRAPHICS);
+      if (uniforms == NULL)
+        {
+          KYU_LOG_WARNING("Can't grow the uniform location cache");
+          uniforms = old;
+          uniform_capacity = old_capacity;
+          return;
+        }
+
+      nb_uniforms = 0;
+      for (i = 0; i < old_capacity; ++i)
+        if (old[i].program != 0)
+          add_uniform(old[i].program, old[i].name, old[i].location);
+      kyu_free(old);
+    }
+
+  added.program  = program;
+  added.location = location;
+  added.hash     = hash;
+  strncpy(added.name, name, KYU_GL_UNIFORM_NAME - 1);
+  added.name[KYU_GL_UNIFORM_NAME - 1] = '\0';
+  place_uniform(&added);
+}
+
+static void
+place_uniform(const uniform *u)
+{
+  unsigned long i, mask = uniform_capacity - 1;
+
+  for (i = u->hash & mask; uniforms[i].program != 0; i = (i + 1) & mask)
+    ;
+
+  uniforms[i] = *u;
+  nb_uniforms++;
+}
+
+
+/* Each removal moves the rest of its cluster back, passes go on until a
+   whole one finds nothing since moved entries may wrap behind the scan */
+static void
+remove_uniforms(GLuint program)
+{
+  unsigned long i, j, mask = uniform_capacity - 1;
+  uniform moved;
+  int removed = 1;
+
+  if (program == 0)
+    return;
+
+  while (uniforms != NULL && removed)
+    {
+      removed = 0;
+      for (i = 0; i < uniform_capacity; ++i)
+        {
+          if (uniforms[i].program == 0 || uniforms[i].program != program)
+            continue;
+
+          uniforms[i].program = 0;
+          nb_uniforms--;
+          removed = 1;
+
+          for (j = (i + 1) & mask; uniforms[j].program != 0; j = (j + 1) & mask)
+            {
+              moved = uniforms[j];
+              uniforms[j].program = 0;
+              nb_uniforms--;
+              place_uniform(&moved);
+            }
+        }
+    }
+}
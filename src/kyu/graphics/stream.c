@@ -0,0 +1,234 @@
+/* stream -- persistently mapped buffers for per-frame data
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/graphics/stream.h"
+#include "kyu/graphics/state.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/profile.h"
+
+#include <string.h>
+
+/* A fence wait is retried in slices this long, in nanoseconds */
+#define WAIT_SLICE 1000000
+
+#define STORAGE_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+static GLsizeiptr align(GLsizeiptr size, GLint alignment);
+static int create_storage(kyu_stream *stream);
+static void destroy_storage(kyu_stream *stream);
+static void wait_region(kyu_stream *stream, int region);
+
+int
+kyu_stream_init(kyu_stream *stream, GLsizeiptr region_size, GLint alignment)
+{
+  KYU_ASSERT(stream != NULL, "No stream provided");
+  KYU_ASSERT(region_size > 0, "Stream regions can't be empty");
+  if (stream == NULL || region_size <= 0)
+    return -1;
+
+  memset(stream, 0, sizeof(kyu_stream));
+  stream->alignment   = MAX(alignment, 1);
+  stream->region_size = align(region_size, stream->alignment);
+  stream->persistent  = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+
+  return create_storage(stream);
+}
+
+void
+kyu_stream_release(kyu_stream *stream)
+{
+  KYU_ASSERT(stream != NULL, "No stream provided");
+  if (stream == NULL)
+    return;
+
+  destroy_storage(stream);
+  memset(stream, 0, sizeof(kyu_stream));
+}
+
+int
+kyu_stream_begin(kyu_stream *stream)
+{
+  KYU_ASSERT(stream != NULL, "No stream provided");
+  if (stream == NULL || stream->buffer == 0)
+    return -1;
+
+  kyu_stream_commit(stream);
+
+  /* Every command reading the region was issued before this begin */
+  if (stream->region >= 0)
+    stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  /* Storage can't be resized, a new buffer takes over. The old one is
+     freed by the driver once the GPU is done with it. */
+  if (stream->wanted > stream->region_size)
+    {
+      destroy_storage(stream);
+      stream->region_size = align(MAX(stream->wanted, stream->region_size * 2),
+                                  stream->alignment);
+      if (create_storage(stream) != 0)
+        return -1;
+    }
+  stream->wanted = 0;
+
+  stream->region = (stream->region + 1) % KYU_STREAM_REGIONS;
+  stream->offset = 0;
+  wait_region(stream, stream->region);
+
+  return 0;
+}
+
+void *
+kyu_stream_alloc(kyu_stream *stream, GLsizeiptr size, GLintptr *offset)
+{
+  GLsizeiptr start, base;
+
+  KYU_ASSERT(stream != NULL, "No stream provided");
+  KYU_ASSERT(stream == NULL || stream->region >= 0, "Stream used before a begin");
+  if (stream == NULL || stream->region < 0 || size <= 0)
+    return NULL;
+
+  start = align(stream->offset, stream->alignment);
+  if (start + size > stream->region_size)
+    {
+      /* What the whole frame needs, counting what did not fit */
+      stream->wanted = MAX(stream->wanted, stream->region_size) + size + stream->alignment;
+      KYU_LOG_WARNING("Stream region full, it grows next frame");
+      return NULL;
+    }
+
+  base = stream->region * stream->region_size;
+  stream->offset = start + size;
+  if (offset != NULL)
+    *offset = base + start;
+
+  if (stream->persistent)
+    return stream->data + base + start;
+
+  /* The fence was waited on, nothing reads what follows `start` */
+  if (stream->data == NULL)
+    {
+      kyu_gl_bind_buffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+      stream->data = glMapBufferRange(GL_COPY_WRITE_BUFFER, base + start,
+                                      stream->region_size - start,
+                                      GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+                                      | GL_MAP_INVALIDATE_RANGE_BIT);
+      KYU_ASSERT(stream->data != NULL, "Can't map the stream region");
+      if (stream->data == NULL)
+        return NULL;
+      stream->mapped = start;
+    }
+
+  return stream->data + (start - stream->mapped);
+}
+
+/* Coherent mappings need neither a flush nor a barrier */
+void
+kyu_stream_commit(kyu_stream *stream)
+{
+  KYU_ASSERT(stream != NULL, "No stream provided");
+  if (stream == NULL || stream->persistent || stream->data == NULL)
+    return;
+
+  kyu_gl_bind_buffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+  if (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_FALSE)
+    KYU_LOG_WARNING("Stream buffer corrupted while mapped");
+  stream->data = NULL;
+}
+
+static GLsizeiptr
+align(GLsizeiptr size, GLint alignment)
+{
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+static int
+create_storage(kyu_stream *stream)
+{
+  GLsizeiptr size = stream->region_size * KYU_STREAM_REGIONS;
+
+  stream->region = -1;
+  stream->offset = 0;
+
+  glGenBuffers(1, &stream->buffer);
+  kyu_gl_bind_buffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+
+  if (!stream->persistent)
+    {
+      glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+      return 0;
+    }
+
+  glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, STORAGE_FLAGS);
+  stream->data = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, STORAGE_FLAGS);
+  KYU_ASSERT(stream->data != NULL, "Can't map the stream buffer");
+  if (stream->data == NULL)
+    {
+      kyu_gl_delete_buffers(1, &stream->buffer);
+      stream->buffer = 0;
+      return -1;
+    }
+
+  return 0;
+}
+
+static void
+destroy_storage(kyu_stream *stream)
+{
+  int i;
+
+  for (i = 0; i < KYU_STREAM_REGIONS; ++i)
+    if (stream->fences[i] != NULL)
+      {
+        glDeleteSync(stream->fences[i]);
+        stream->fences[i] = NULL;
+      }
+
+  if (stream->buffer == 0)
+    return;
+
+  if (stream->data != NULL)
+    {
+      kyu_gl_bind_buffer(GL_COPY_WRITE_BUFFER, stream->buffer);
+      glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+      stream->data = NULL;
+    }
+
+  kyu_gl_delete_buffers(1, &stream->buffer);
+  stream->buffer = 0;
+}
+
+static void
+wait_region(kyu_stream *stream, int region)
+{
+  GLenum result;
+
+  if (stream->fences[region] == NULL)
+    return;
+
+  KYU_PROFILE_BEGIN("kyu_stream_wait");
+  do
+    result = glClientWaitSync(stream->fences[region], GL_SYNC_FLUSH_COMMANDS_BIT,
+                              WAIT_SLICE);
+  while (result == GL_TIMEOUT_EXPIRED);
+  KYU_PROFILE_END();
+
+  if (result == GL_WAIT_FAILED)
+    KYU_LOG_WARNING("Can't wait on a stream region");
+
+  glDeleteSync(stream->fences[region]);
+  stream->fences[region] = NULL;
+}
@@ -0,0 +1,219 @@
+/* timer -- GPU time of the frame and of named passes
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/graphics/timer.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/stats.h"
+
+#include <string.h>
+
+/* The queries of one frame in flight */
+typedef struct {
+  GLuint start;
+  GLuint end;
+  GLuint passes[KYU_GPU_TIMER_PASSES];
+  const char *names[KYU_GPU_TIMER_PASSES];
+  int nb_passes;
+  long frame;
+  int pending;
+} timer_frame;
+
+static timer_frame frames[KYU_GPU_TIMER_FRAMES];
+
+static kyu_gpu_pass results[KYU_GPU_TIMER_PASSES];
+static int nb_results = 0;
+static long results_frame = -1;
+
+/* 1 once the queries exist, -1 when the context has no timer queries */
+static int created = 0;
+static long frame = 0;
+static timer_frame *current = NULL;
+static int active = 0;
+
+static int  create_queries(void);
+static void collect(timer_frame *f);
+
+void
+kyu_gpu_frame_begin(void)
+{
+  timer_frame *f;
+
+  KYU_ASSERT(current == NULL, "GPU frame begun twice");
+  if (current != NULL || (created == 0 && create_queries() != 0) || created < 0)
+    return;
+
+  f = &frames[frame % KYU_GPU_TIMER_FRAMES];
+  if (f->pending)
+    collect(f);
+
+  f->nb_passes = 0;
+  f->frame = frame;
+  glQueryCounter(f->start, GL_TIMESTAMP);
+  current = f;
+}
+
+void
+kyu_gpu_frame_end(void)
+{
+  if (current == NULL)
+    return;
+
+  /* A pass left open ends with the frame */
+  if (active)
+    kyu_gpu_pass_end();
+
+  glQueryCounter(current->end, GL_TIMESTAMP);
+  current->pending = 1;
+  current = NULL;
+  frame++;
+}
+
+void
+kyu_gpu_timers_release(void)
+{
+  int i;
+
+  if (created > 0)
+    for (i = 0; i < KYU_GPU_TIMER_FRAMES; ++i)
+      {
+        glDeleteQueries(1, &frames[i].start);
+        glDeleteQueries(1, &frames[i].end);
+        glDeleteQueries(KYU_GPU_TIMER_PASSES, frames[i].passes);
+      }
+
+  memset(frames, 0, sizeof(frames));
+  nb_results = 0;
+  results_frame = -1;
+  created = 0;
+  frame = 0;
+  current = NULL;
+  active = 0;
+}
+
+void
+kyu_gpu_pass_begin(const char *name)
+{
+  static int warned = 0;
+
+  KYU_ASSERT(name != NULL, "No pass name provided");
+  KYU_ASSERT(!active, "GPU passes can't be nested");
+  if (name == NULL || active || current == NULL)
+    return;
+
+  if (current->nb_passes >= KYU_GPU_TIMER_PASSES)
+    {
+      if (!warned)
+        KYU_LOG_WARNING("More than %d GPU passes in a frame", KYU_GPU_TIMER_PASSES);
+      warned = 1;
+      return;
+    }
+
+  current->names[current->nb_passes] = name;
+  glBeginQuery(GL_TIME_ELAPSED, current->passes[current->nb_passes]);
+  active = 1;
+}
+
+void
+kyu_gpu_pass_end(void)
+{
+  if (!active)
+    return;
+
+  glEndQuery(GL_TIME_ELAPSED);
+  current->nb_passes++;
+  active = 0;
+}
+
+int
+kyu_gpu_passes(const kyu_gpu_pass **passes, long *from)
+{
+  KYU_ASSERT(passes != NULL, "No pass array provided");
+  if (passes == NULL)
+    return -1;
+
+  *passes = results;
+  if (from != NULL)
+    *from = results_frame;
+
+  return nb_results;
+}
+
+static int
+create_queries(void)
+{
+  int i;
+
+  if (!GLAD_GL_VERSION_3_3 && !GLAD_GL_ARB_timer_query)
+    {
+      KYU_LOG_WARNING("No timer queries, the GPU time is not measured");
+      created = -1;
+      return -1;
+    }
+
+  for (i = 0; i < KYU_GPU_TIMER_FRAMES; ++i)
+    {
+      glGenQueries(1, &frames[i].start);
+      glGenQueries(1, &frames[i].end);
+      glGenQueries(KYU_GPU_TIMER_PASSES, frames[i].passes);
+    }
+  created = 1;
+
+  return 0;
+}
+
+/* Results not there yet are dropped rather than waited on, the frame
+   simply has no GPU sample */
+static void
+collect(timer_frame *f)
+{
+  GLuint64 start, end, elapsed[KYU_GPU_TIMER_PASSES];
+  GLint available = 0;
+  int i;
+
+  f->pending = 0;
+
+  glGetQueryObjectiv(f->end, GL_QUERY_RESULT_AVAILABLE, &available);
+  for (i = 0; i < f->nb_passes && available; ++i)
+    glGetQueryObjectiv(f->passes[i], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available)
+    return;
+
+  glGetQueryObjectui64v(f->start, GL_QUERY_RESULT, &start);
+  glGetQueryObjectui64v(f->end, GL_QUERY_RESULT, &end);
+  if (end < start)
+    return;
+
+  /* A pass can't outlast its frame, some drivers get the first query of
+     a context wrong. The previous results stay whole until all passes
+     are checked. */
+  for (i = 0; i < f->nb_passes; ++i)
+    {
+      glGetQueryObjectui64v(f->passes[i], GL_QUERY_RESULT, &elapsed[i]);
+      if (elapsed[i] > end - start)
+        return;
+    }
+
+  for (i = 0; i < f->nb_passes; ++i)
+    {
+      results[i].name = f->names[i];
+      results[i].seconds = (double)elapsed[i] * 1e-9;
+    }
+  nb_results = f->nb_passes;
+  results_frame = f->frame;
+
+  kyu_stats_record(KYU_STAT_GPU, (double)(end - start) * 1e-9);
+}
@@ -0,0 +1,120 @@
+/* uniform -- per-frame uniform buffer ring
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/graphics/uniform.h"
+#include "kyu/graphics/state.h"
+#include "kyu/core/utils.h"
+
+#include <string.h>
+
+int
+kyu_uniform_ring_init(kyu_uniform_ring *ring, GLsizeiptr size)
+{
+  GLint alignment = 1;
+
+  KYU_ASSERT(ring != NULL, "No uniform ring provided");
+  if (ring == NULL)
+    return -1;
+
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+  return kyu_stream_init(&ring->stream, size, alignment);
+}
+
+void
+kyu_uniform_ring_release(kyu_uniform_ring *ring)
+{
+  KYU_ASSERT(ring != NULL, "No uniform ring provided");
+  if (ring == NULL)
+    return;
+
+  kyu_stream_release(&ring->stream);
+}
+
+int
+kyu_uniform_ring_begin(kyu_uniform_ring *ring)
+{
+  KYU_ASSERT(ring != NULL, "No uniform ring provided");
+  if (ring == NULL)
+    return -1;
+
+  return kyu_stream_begin(&ring->stream);
+}
+
+void
+kyu_uniform_ring_end(kyu_uniform_ring *ring)
+{
+  KYU_ASSERT(ring != NULL, "No uniform ring provided");
+  if (ring == NULL)
+    return;
+
+  kyu_stream_commit(&ring->stream);
+}
+
+void *
+kyu_uniform_ring_alloc(kyu_uniform_ring *ring, GLsizeiptr size, GLintptr *offset)
+{
+  KYU_ASSERT(ring != NULL, "No uniform ring provided");
+  if (ring == NULL)
+    return NULL;
+
+  return kyu_stream_alloc(&ring->stream, size, offset);
+}
+
+GLintptr
+kyu_uniform_ring_push(kyu_uniform_ring *ring, const void *block, GLsizeiptr size)
+{
+  GLintptr offset;
+  void *dest;
+
+  dest = kyu_uniform_ring_alloc(ring, size, &offset);
+  if (dest == NULL)
+    return -1;
+
+  memcpy(dest, block, (size_t)size);
+
+  return offset;
+}
+
+void
+kyu_uniform_ring_bind(const kyu_uniform_ring *ring, GLuint binding,
+                      GLintptr offset, GLsizeiptr size)
+{
+  KYU_ASSERT(ring != NULL, "No uniform ring provided");
+  if (ring == NULL || offset < 0)
+    return;
+
+  kyu_gl_bind_buffer_range(GL_UNIFORM_BUFFER, binding, ring->stream.buffer, offset, size);
+}
+
+int
+kyu_uniform_block_binding(GLuint program, const char *name, GLuint binding)
+{
+  GLuint index;
+
+  KYU_ASSERT(name != NULL, "No uniform block name provided");
+  if (name == NULL)
+    return -1;
+
+  index = glGetUniformBlockIndex(program, name);
+  if (index == GL_INVALID_INDEX)
+    return -1;
+
+  glUniformBlockBinding(program, index, binding);
+
+  return 0;
+}
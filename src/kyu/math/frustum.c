@@ -0,0 +1,305 @@
+/* frustum -- view frustum extraction and batch culling
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/math/frustum.h"
+#include "kyu/core/utils.h"
+#include "math/simd.h"
+
+#include <stdlib.h>
+
+static unsigned char classify_sphere(kyu_frustum *frustum, kyu_vec *sphere);
+static unsigned char classify_aabb(kyu_frustum *frustum, kyu_aabb *box);
+static int emit(unsigned char result, int index,
+                unsigned char *results, int *visible, int nb_visible);
+#ifdef KYU_SSE
+static int emit4(__m128 outside, __m128 intersect, int index,
+                 unsigned char *results, int *visible, int nb_visible);
+#endif /* KYU_SSE */
+
+kyu_frustum
+kyu_frustum_from_matrix(kyu_matrix *view_proj)
+{
+  int i, j;
+  float *m, l;
+  kyu_frustum ret;
+  kyu_vec *plane;
+
+  for (i = 0; i < 6; ++i)
+    ret.planes[i] = kyu_vec_init(0.f, 0.f, 0.f);
+
+  KYU_ASSERT(view_proj != NULL, "No matrix provided");
+  if (view_proj == NULL)
+    return ret;
+
+  KYU_ASSERT(view_proj->width == 4 && view_proj->height == 4,
+             "Matrix width or height is not 4");
+  if (view_proj->width != 4 || view_proj->height != 4)
+    return ret;
+
+  /* Clip space is -w <= x, y, z <= w: each plane is the last row plus or
+     minus one of the first three */
+  m = view_proj->t;
+  for (i = 0; i < 6; ++i)
+    {
+      float sign = (i % 2 == 0) ? 1.f : -1.f;
+      float *row = &m[(i / 2) * 4];
+
+      plane = &ret.planes[i];
+      for (j = 0; j < 4; ++j)
+        (&plane->x)[j] = m[12 + j] + sign * row[j];
+
+      l = length(plane);
+      if (l > 0.f)
+        {
+          l = 1.f / l;
+          plane->x *= l;
+          plane->y *= l;
+          plane->z *= l;
+          plane->w *= l;
+        }
+    }
+
+  return ret;
+}
+
+int
+kyu_frustum_cull_spheres(kyu_frustum *frustum, kyu_vec *spheres, int count,
+                         unsigned char *results, int *visible)
+{
+  int i, nb_visible;
+
+  KYU_ASSERT(frustum != NULL, "No frustum provided");
+  KYU_ASSERT(spheres != NULL || count == 0, "No spheres provided");
+  if (frustum == NULL || (spheres == NULL && count > 0))
+    return 0;
+
+  i = nb_visible = 0;
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    {
+      int p;
+      __m128 x, y, z, r, nr, d, outside, intersect;
+
+      x = _mm_loadu_ps(&spheres[i].x);
+      y = _mm_loadu_ps(&spheres[i + 1].x);
+      z = _mm_loadu_ps(&spheres[i + 2].x);
+      r = _mm_loadu_ps(&spheres[i + 3].x);
+      _MM_TRANSPOSE4_PS(x, y, z, r);
+
+      nr = _mm_sub_ps(_mm_setzero_ps(), r);
+      outside = intersect = _mm_setzero_ps();
+      for (p = 0; p < 6; ++p)
+        {
+          kyu_vec *plane = &frustum->planes[p];
+
+          d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane->x)),
+                                    _mm_mul_ps(y, _mm_set1_ps(plane->y))),
+                         _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane->z)),
+                                    _mm_set1_ps(plane->w)));
+
+          outside   = _mm_or_ps(outside,   _mm_cmplt_ps(d, nr));
+          intersect = _mm_or_ps(intersect, _mm_cmplt_ps(d, r));
+        }
+
+      nb_visible = emit4(outside, intersect, i, results, visible, nb_visible);
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    nb_visible = emit(classify_sphere(frustum, &spheres[i]), i,
+                      results, visible, nb_visible);
+
+  return nb_visible;
+}
+
+int
+kyu_frustum_cull_aabbs(kyu_frustum *frustum, kyu_aabb *boxes, int count,
+                       unsigned char *results, int *visible)
+{
+  int i, nb_visible;
+
+  KYU_ASSERT(frustum != NULL, "No frustum provided");
+  KYU_ASSERT(boxes != NULL || count == 0, "No boxes provided");
+  if (frustum == NULL || (boxes == NULL && count > 0))
+    return 0;
+
+  i = nb_visible = 0;
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    {
+      int p;
+      __m128 half, sign, cx, cy, cz, cw, ex, ey, ez, ew, a, b;
+      __m128 d, r, outside, intersect;
+
+      cx = _mm_loadu_ps(&boxes[i].min.x);
+      cy = _mm_loadu_ps(&boxes[i + 1].min.x);
+      cz = _mm_loadu_ps(&boxes[i + 2].min.x);
+      cw = _mm_loadu_ps(&boxes[i + 3].min.x);
+      _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+
+      ex = _mm_loadu_ps(&boxes[i].max.x);
+      ey = _mm_loadu_ps(&boxes[i + 1].max.x);
+      ez = _mm_loadu_ps(&boxes[i + 2].max.x);
+      ew = _mm_loadu_ps(&boxes[i + 3].max.x);
+      _MM_TRANSPOSE4_PS(ex, ey, ez, ew);
+
+      /* Center and half extent from min and max */
+      half = _mm_set1_ps(0.5f);
+      a = cx; b = ex;
+      cx = _mm_mul_ps(_mm_add_ps(a, b), half);
+      ex = _mm_mul_ps(_mm_sub_ps(b, a), half);
+      a = cy; b = ey;
+      cy = _mm_mul_ps(_mm_add_ps(a, b), half);
+      ey = _mm_mul_ps(_mm_sub_ps(b, a), half);
+      a = cz; b = ez;
+      cz = _mm_mul_ps(_mm_add_ps(a, b), half);
+      ez = _mm_mul_ps(_mm_sub_ps(b, a), half);
+
+      sign = _mm_set1_ps(-0.f);
+      outside = intersect = _mm_setzero_ps();
+      for (p = 0; p < 6; ++p)
+        {
+          kyu_vec *plane = &frustum->planes[p];
+          __m128 px = _mm_set1_ps(plane->x);
+          __m128 py = _mm_set1_ps(plane->y);
+          __m128 pz = _mm_set1_ps(plane->z);
+
+          d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, px), _mm_mul_ps(cy, py)),
+                         _mm_add_ps(_mm_mul_ps(cz, pz), _mm_set1_ps(plane->w)));
+          r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_andnot_ps(sign, px)),
+                                    _mm_mul_ps(ey, _mm_andnot_ps(sign, py))),
+                         _mm_mul_ps(ez, _mm_andnot_ps(sign, pz)));
+
+          outside   = _mm_or_ps(outside,   _mm_cmplt_ps(d, _mm_sub_ps(_mm_setzero_ps(), r)));
+          intersect = _mm_or_ps(intersect, _mm_cmplt_ps(d, r));
+        }
+
+      nb_visible = emit4(outside, intersect, i, results, visible, nb_visible);
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    nb_visible = emit(classify_aabb(frustum, &boxes[i]), i,
+                      results, visible, nb_visible);
+
+  return nb_visible;
+}
+
+static unsigned char
+classify_sphere(kyu_frustum *frustum, kyu_vec *sphere)
+{
+  int p;
+  float d;
+  unsigned char ret = KYU_CULL_INSIDE;
+
+  for (p = 0; p < 6; ++p)
+    {
+      kyu_vec *plane = &frustum->planes[p];
+
+      d = (sphere->x * plane->x + sphere->y * plane->y)
+        + (sphere->z * plane->z + plane->w);
+
+      if (d < -sphere->w)
+        return KYU_CULL_OUTSIDE;
+
+      if (d < sphere->w)
+        ret = KYU_CULL_INTERSECT;
+    }
+
+  return ret;
+}
+
+static unsigned char
+classify_aabb(kyu_frustum *frustum, kyu_aabb *box)
+{
+  int p;
+  float d, r;
+  kyu_point c, e;
+  unsigned char ret = KYU_CULL_INSIDE;
+
+  c = kyu_point_init((box->min.x + box->max.x) * 0.5f,
+                     (box->min.y + box->max.y) * 0.5f,
+                     (box->min.z + box->max.z) * 0.5f);
+  e = kyu_point_init((box->max.x - box->min.x) * 0.5f,
+                     (box->max.y - box->min.y) * 0.5f,
+                     (box->max.z - box->min.z) * 0.5f);
+
+  for (p = 0; p < 6; ++p)
+    {
+      kyu_vec *plane = &frustum->planes[p];
+
+      d = (c.x * plane->x + c.y * plane->y) + (c.z * plane->z + plane->w);
+      r = (e.x * fabsf(plane->x) + e.y * fabsf(plane->y)) + e.z * fabsf(plane->z);
+
+      if (d < -r)
+        return KYU_CULL_OUTSIDE;
+
+      if (d < r)
+        ret = KYU_CULL_INTERSECT;
+    }
+
+  return ret;
+}
+
+static int
+emit(unsigned char result, int index,
+     unsigned char *results, int *visible, int nb_visible)
+{
+  if (results != NULL)
+    results[index] = result;
+
+  if (result != KYU_CULL_OUTSIDE)
+    {
+      if (visible != NULL)
+        visible[nb_visible] = index;
+      nb_visible++;
+    }
+
+  return nb_visible;
+}
+
+#ifdef KYU_SSE
+static int
+emit4(__m128 outside, __m128 intersect, int index,
+      unsigned char *results, int *visible, int nb_visible)
+{
+  int i, in, inter;
+
+  in    = ~_mm_movemask_ps(outside);
+  inter = _mm_movemask_ps(intersect);
+
+  /* Branchless: OUTSIDE is 0, INTERSECT 1 and INSIDE 2 */
+  if (results != NULL)
+    {
+      for (i = 0; i < 4; ++i)
+        results[index + i] = (unsigned char)(((in >> i) & 1) * (2 - ((inter >> i) & 1)));
+    }
+
+  if (visible == NULL)
+    return nb_visible + ((in & 1) + ((in >> 1) & 1) + ((in >> 2) & 1) + ((in >> 3) & 1));
+
+  for (i = 0; i < 4; ++i)
+    {
+      visible[nb_visible] = index + i;
+      nb_visible += (in >> i) & 1;
+    }
+
+  return nb_visible;
+}
+#endif /* KYU_SSE */
@@ -16,21 +16,47 @@
    along with this program. If not, see <http://www.gnu.org/licenses/>. */
 
 #include "kyu/math/matrix.h"
+#include "kyu/math/trig.h"
 #include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
+#include "kyu/core/frame.h"
+#include "math/simd.h"
 
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+/* Aliased products up to 4x4 are computed on the stack */
+#define KYU_MATRIX_STACK 16
+
+/* Frame matrices keep their tab right after this header */
+#define FRAME_HEADER \
+  ((sizeof(kyu_matrix) + KYU_FRAME_ALIGN - 1) & ~(size_t)(KYU_FRAME_ALIGN - 1))
 
 static kyu_vec get_matrix_column(kyu_matrix *matrix, int column);
 static void set_matrix_column(kyu_matrix *matrix, kyu_vec *vec, int column);
+static int  check_affine(kyu_matrix *dest, kyu_matrix *matrix);
+static float *scratch_alloc(float *stack, int count);
+static void   scratch_free(float *stack, float *tab);
+static void load_affine(float *m, kyu_matrix *matrix);
+static void store_affine(kyu_matrix *dest, const float *m);
+#ifdef KYU_SSE
+static __m128 hsum(__m128 v);
+static __m128 cross3(__m128 a, __m128 b);
+static __m128 translate_inverse(__m128 c0, __m128 c1, __m128 c2,
+                                __m128 r0, __m128 r1, __m128 r2);
+static __m128 mat2_mult(__m128 a, __m128 b);
+static __m128 mat2_adj_mult(__m128 a, __m128 b);
+static __m128 mat2_mult_adj(__m128 a, __m128 b);
+#endif /* KYU_SSE */
 
 kyu_matrix *
 kyu_matrix_init(int height, int width)
 {
   kyu_matrix *mat;
 
-  mat = (kyu_matrix *)malloc(sizeof(kyu_matrix));
+  mat = (kyu_matrix *)kyu_malloc(sizeof(kyu_matrix), KYU_MEMORY_MATH);
   KYU_ASSERT(mat != NULL, "Can't allocate memory for the matrix structure");
   if (mat == NULL)
     return mat;
@@ -38,12 +64,36 @@ kyu_matrix_init(int height, int width)
   mat->width = width;
   mat->height = height;
 
-  mat->t = (float *)malloc(height * width * sizeof(float));
+  mat->t = (float *)kyu_malloc(height * width * sizeof(float), KYU_MEMORY_MATH);
   KYU_ASSERT(mat->t != NULL, "Can't allocate memory for the matrix tab");
 
   return mat;
 }
 
+kyu_matrix *
+kyu_matrix_frame_init(int height, int width)
+{
+  kyu_matrix *mat;
+
+  /* Structure and tab in one block, aligned for the SIMD loads */
+  mat = (kyu_matrix *)kyu_frame_alloc(FRAME_HEADER + height * width * sizeof(float));
+  KYU_ASSERT(mat != NULL, "Can't allocate the matrix from the frame arena");
+  if (mat == NULL)
+    return mat;
+
+  mat->width = width;
+  mat->height = height;
+  mat->t = (float *)((unsigned char *)mat + FRAME_HEADER);
+
+  return mat;
+}
+
+kyu_matrix *
+kyu_matrix_frame_init4x4()
+{
+  return kyu_matrix_frame_init(4, 4);
+}
+
 kyu_matrix *
 kyu_matrix_init4x4()
 {
@@ -115,8 +165,15 @@ kyu_matrix_release(kyu_matrix *matrix)
   if (matrix->t == NULL)
     return -1;
 
-  free(matrix->t);
-  free(matrix);
+  /* Told apart by their inline tab, whichever thread releases them: a
+     heap tab is a block of its own and can't start right there */
+  KYU_ASSERT((unsigned char *)matrix->t != (unsigned char *)matrix + FRAME_HEADER,
+             "Matrix from a frame arena, it is freed by the next ticks");
+  if ((unsigned char *)matrix->t == (unsigned char *)matrix + FRAME_HEADER)
+    return -1;
+
+  kyu_free(matrix->t);
+  kyu_free(matrix);
 
   return 0;
 }
@@ -124,9 +181,8 @@ kyu_matrix_release(kyu_matrix *matrix)
 void
 kyu_matrix_transpose(kyu_matrix *dest, kyu_matrix *matrix)
 {
-  int i, j;
-  float *tab;
-  kyu_matrix *temp;
+  int i, j, width, height;
+  float stack[KYU_MATRIX_STACK], *tab;
 
   KYU_ASSERT(dest != NULL, "No destination matrix provided");
   KYU_ASSERT(matrix != NULL, "No source matrix provided");
@@ -137,23 +193,27 @@ kyu_matrix_transpose(kyu_matrix *dest, kyu_matrix *matrix)
              "Size of matrices doesn't match");
   if (dest->height != matrix->width || dest->width != matrix->height)
     return;
-  
-  temp = dest;
+
+  width = matrix->width;
+  height = matrix->height;
+
+  tab = dest->t;
   if (dest == matrix)
-    temp = kyu_matrix_init(matrix->width, matrix->height);
+    tab = scratch_alloc(stack, width * height);
+  if (tab == NULL)
+    return;
 
-  for (i = 0; i < matrix->width; ++i)
+  for (i = 0; i < width; ++i)
     {
-      for (j = 0; j < matrix->height; ++j)
-        temp->t[i * matrix->height + j] = matrix->t[j * matrix->width + i];
+      for (j = 0; j < height; ++j)
+        tab[i * height + j] = matrix->t[j * width + i];
     }
 
-  tab = temp->t;
-  temp->t = dest->t;
-  dest->t = tab;
-
   if (dest == matrix)
-    kyu_matrix_release(temp);
+    {
+      memcpy(dest->t, tab, width * height * sizeof(float));
+      scratch_free(stack, tab);
+    }
 }
 
 static kyu_vec
@@ -308,9 +368,8 @@ kyu_matrix_sub(kyu_matrix *dest, kyu_matrix *a, kyu_matrix *b)
 void
 kyu_matrix_mult(kyu_matrix *dest, kyu_matrix *a, kyu_matrix *b)
 {
-  int i, j, k;
-  float s, *tab;
-  kyu_matrix *temp = NULL;
+  int i, j, k, aliased;
+  float s, stack[KYU_MATRIX_STACK], *tab;
   
   KYU_ASSERT(dest != NULL, "No destination matrix provided");
   KYU_ASSERT(a != NULL, "No left matrix provided");
@@ -323,37 +382,45 @@ kyu_matrix_mult(kyu_matrix *dest, kyu_matrix *a, kyu_matrix *b)
   if (dest->height != a->height || a->width != b->height)
     return;
 
-  temp = dest;
-  if (dest == a || dest == b)
-    temp = kyu_matrix_init(a->height, b->width);
+  /* dest takes the width of b, its tab must be large enough */
+  KYU_ASSERT(dest->width >= b->width, "Destination matrix is too small");
+  if (dest->width < b->width)
+    return;
+
+  aliased = (dest == a || dest == b);
+  tab = dest->t;
+  if (aliased)
+    tab = scratch_alloc(stack, a->height * b->width);
+  if (tab == NULL)
+    return;
 
-  for (i = 0; i < temp->height; ++i)
+  for (i = 0; i < a->height; ++i)
     {
-      for (j = 0; j < temp->width; ++j)
+      for (j = 0; j < b->width; ++j)
         {
           s = 0.f;
           for (k = 0; k < a->width; ++k)
             s += a->t[i * a->width + k] * b->t[k * b->width + j];
 
-          temp->t[i * temp->width + j] = s;
+          tab[i * b->width + j] = s;
         }
     }
 
+  if (aliased)
+    {
+      memcpy(dest->t, tab, a->height * b->width * sizeof(float));
+      scratch_free(stack, tab);
+    }
+
   dest->height = a->height;
   dest->width = b->width;
-  
-  tab = temp->t;
-  temp->t = dest->t;
-  dest->t = tab;
-
-  if (dest == a || dest == b)
-    kyu_matrix_release(temp);
 }
 
 void
 kyu_matrix_mult_vec(kyu_matrix *dest, kyu_matrix *a, kyu_vec *b)
 {
-  kyu_matrix *temp;
+  float tab[4];
+  kyu_matrix temp;
 
   KYU_ASSERT(dest != NULL, "No destination vector provided");
   KYU_ASSERT(a != NULL, "No left matrix provided");
@@ -366,22 +433,22 @@ kyu_matrix_mult_vec(kyu_matrix *dest, kyu_matrix *a, kyu_vec *b)
   if (a->width != 3 && a->width != 4)
     return;
   
-  temp = kyu_matrix_init(a->width, 1);
-  temp->t[0] = b->x;
-  temp->t[1] = b->y;
-  temp->t[2] = b->z;
-  if (a->width == 4)
-    temp->t[3] = b->w;
-
-  kyu_matrix_mult(dest, a, temp);
-
-  kyu_matrix_release(temp);
+  temp.width = 1;
+  temp.height = a->width;
+  temp.t = tab;
+  tab[0] = b->x;
+  tab[1] = b->y;
+  tab[2] = b->z;
+  tab[3] = b->w;
+
+  kyu_matrix_mult(dest, a, &temp);
 }
 
 void
 kyu_matrix_mult_vec2(kyu_matrix *dest, kyu_matrix *a, kyu_vec *b)
 {
-  kyu_matrix *temp;
+  float tab[2];
+  kyu_matrix temp;
 
   KYU_ASSERT(dest != NULL, "No destination vector provided");
   KYU_ASSERT(a != NULL, "No left matrix provided");
@@ -393,13 +460,349 @@ kyu_matrix_mult_vec2(kyu_matrix *dest, kyu_matrix *a, kyu_vec *b)
   if (a->width != 2)
     return;
   
-  temp = kyu_matrix_init(2, 1);
-  temp->t[0] = b->x;
-  temp->t[1] = b->y;
+  temp.width = 1;
+  temp.height = 2;
+  temp.t = tab;
+  tab[0] = b->x;
+  tab[1] = b->y;
+
+  kyu_matrix_mult(dest, a, &temp);
+}
+
+int
+kyu_matrix_inverse(kyu_matrix *dest, kyu_matrix *matrix)
+{
+  int i;
+  float m[16];
+#ifdef KYU_SSE
+  __m128 r0, r1, r2, r3, a, b, c, d, det_sub, det_a, det_b, det_c, det_d;
+  __m128 a_b, d_c, x, y, z, w, det, tr;
+#else
+  float inv[16], det;
+#endif
 
-  kyu_matrix_mult(dest, a, temp);
+  KYU_ASSERT(dest != NULL, "No destination matrix provided");
+  KYU_ASSERT(matrix != NULL, "No source matrix provided");
+  if (dest == NULL || matrix == NULL)
+    return -1;
+
+  KYU_ASSERT(matrix->width == 4 && matrix->height == 4
+             && dest->width == 4 && dest->height == 4,
+             "Matrices must be 4x4");
+  if (matrix->width != 4 || matrix->height != 4
+      || dest->width != 4 || dest->height != 4)
+    return -1;
+
+  for (i = 0; i < 16; ++i)
+    m[i] = matrix->t[i];
+
+#ifdef KYU_SSE
+  /* Block-wise inverse on the four 2x2 sub-matrices
+     | A B |
+     | C D |, each one stored row-major in a register */
+  r0 = _mm_loadu_ps(&m[0]);
+  r1 = _mm_loadu_ps(&m[4]);
+  r2 = _mm_loadu_ps(&m[8]);
+  r3 = _mm_loadu_ps(&m[12]);
+
+  a = _mm_movelh_ps(r0, r1);
+  b = _mm_movehl_ps(r1, r0);
+  c = _mm_movelh_ps(r2, r3);
+  d = _mm_movehl_ps(r3, r2);
+
+  /* (|A|, |B|, |C|, |D|) */
+  det_sub = _mm_sub_ps(_mm_mul_ps(KYU_SHUFFLE(r0, r2, 0, 2, 0, 2),
+                                  KYU_SHUFFLE(r1, r3, 1, 3, 1, 3)),
+                       _mm_mul_ps(KYU_SHUFFLE(r0, r2, 1, 3, 1, 3),
+                                  KYU_SHUFFLE(r1, r3, 0, 2, 0, 2)));
+  det_a = KYU_SWIZZLE(det_sub, 0, 0, 0, 0);
+  det_b = KYU_SWIZZLE(det_sub, 1, 1, 1, 1);
+  det_c = KYU_SWIZZLE(det_sub, 2, 2, 2, 2);
+  det_d = KYU_SWIZZLE(det_sub, 3, 3, 3, 3);
+
+  d_c = mat2_adj_mult(d, c);
+  a_b = mat2_adj_mult(a, b);
+
+  x = _mm_sub_ps(_mm_mul_ps(det_d, a), mat2_mult(b, d_c));
+  w = _mm_sub_ps(_mm_mul_ps(det_a, d), mat2_mult(c, a_b));
+  y = _mm_sub_ps(_mm_mul_ps(det_b, c), mat2_mult_adj(d, a_b));
+  z = _mm_sub_ps(_mm_mul_ps(det_c, b), mat2_mult_adj(a, d_c));
+
+  /* |M| = |A||D| + |B||C| - tr((A#B)(D#C)) */
+  tr = hsum(_mm_mul_ps(a_b, KYU_SWIZZLE(d_c, 0, 2, 1, 3)));
+  det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d),
+                              _mm_mul_ps(det_b, det_c)),
+                   tr);
+  if (_mm_cvtss_f32(det) == 0.f)
+    return -1;
 
-  kyu_matrix_release(temp);
+  det = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det);
+  x = _mm_mul_ps(x, det);
+  y = _mm_mul_ps(y, det);
+  z = _mm_mul_ps(z, det);
+  w = _mm_mul_ps(w, det);
+
+  _mm_storeu_ps(&m[0],  KYU_SHUFFLE(x, y, 3, 1, 3, 1));
+  _mm_storeu_ps(&m[4],  KYU_SHUFFLE(x, y, 2, 0, 2, 0));
+  _mm_storeu_ps(&m[8],  KYU_SHUFFLE(z, w, 3, 1, 3, 1));
+  _mm_storeu_ps(&m[12], KYU_SHUFFLE(z, w, 2, 0, 2, 0));
+#else
+  inv[0]  =  m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15]
+           + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+  inv[4]  = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15]
+           - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+  inv[8]  =  m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15]
+           + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+  inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14]
+           - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+  inv[1]  = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15]
+           - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+  inv[5]  =  m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15]
+           + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+  inv[9]  = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15]
+           - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+  inv[13] =  m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14]
+           + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+  inv[2]  =  m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15]
+           + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+  inv[6]  = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15]
+           - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+  inv[10] =  m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15]
+           + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+  inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14]
+           - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+  inv[3]  = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11]
+           - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+  inv[7]  =  m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11]
+           + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+  inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11]
+           - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+  inv[15] =  m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10]
+           + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+  det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+  if (det == 0.f)
+    return -1;
+
+  det = 1.f / det;
+  for (i = 0; i < 16; ++i)
+    m[i] = inv[i] * det;
+#endif /* KYU_SSE */
+
+  for (i = 0; i < 16; ++i)
+    dest->t[i] = m[i];
+
+  return 0;
+}
+
+int
+kyu_matrix_inverse_affine(kyu_matrix *dest, kyu_matrix *matrix)
+{
+  float m[16];
+#ifdef KYU_SSE
+  __m128 r0, r1, r2, c0, c1, c2, o, det;
+#else
+  int i;
+  float inv[12], det;
+#endif
+
+  if (check_affine(dest, matrix) != 0)
+    return -1;
+
+  load_affine(m, matrix);
+
+#ifdef KYU_SSE
+  r0 = _mm_loadu_ps(&m[0]);
+  r1 = _mm_loadu_ps(&m[4]);
+  r2 = _mm_loadu_ps(&m[8]);
+
+  /* Columns of the inverse are the cross products of the rows, the w
+     lanes of the products cancel out to 0 */
+  c0 = cross3(r1, r2);
+  c1 = cross3(r2, r0);
+  c2 = cross3(r0, r1);
+
+  det = hsum(_mm_mul_ps(r0, c0));
+  if (_mm_cvtss_f32(det) == 0.f)
+    return -1;
+
+  det = _mm_div_ps(_mm_set1_ps(1.f), det);
+  c0 = _mm_mul_ps(c0, det);
+  c1 = _mm_mul_ps(c1, det);
+  c2 = _mm_mul_ps(c2, det);
+
+  o = translate_inverse(c0, c1, c2, r0, r1, r2);
+  _MM_TRANSPOSE4_PS(c0, c1, c2, o);
+
+  _mm_storeu_ps(&m[0], c0);
+  _mm_storeu_ps(&m[4], c1);
+  _mm_storeu_ps(&m[8], c2);
+#else
+  inv[0]  = m[5] * m[10] - m[6] * m[9];
+  inv[1]  = m[2] * m[9]  - m[1] * m[10];
+  inv[2]  = m[1] * m[6]  - m[2] * m[5];
+  inv[4]  = m[6] * m[8]  - m[4] * m[10];
+  inv[5]  = m[0] * m[10] - m[2] * m[8];
+  inv[6]  = m[2] * m[4]  - m[0] * m[6];
+  inv[8]  = m[4] * m[9]  - m[5] * m[8];
+  inv[9]  = m[1] * m[8]  - m[0] * m[9];
+  inv[10] = m[0] * m[5]  - m[1] * m[4];
+
+  det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8];
+  if (det == 0.f)
+    return -1;
+
+  det = 1.f / det;
+  for (i = 0; i < 3; ++i)
+    {
+      inv[i * 4]     *= det;
+      inv[i * 4 + 1] *= det;
+      inv[i * 4 + 2] *= det;
+      inv[i * 4 + 3] = -(inv[i * 4] * m[3]
+                         + inv[i * 4 + 1] * m[7]
+                         + inv[i * 4 + 2] * m[11]);
+    }
+
+  for (i = 0; i < 12; ++i)
+    m[i] = inv[i];
+#endif /* KYU_SSE */
+
+  store_affine(dest, m);
+
+  return 0;
+}
+
+int
+kyu_matrix_inverse_rigid(kyu_matrix *dest, kyu_matrix *matrix)
+{
+  float m[16];
+#ifdef KYU_SSE
+  __m128 r0, r1, r2, c0, c1, c2, o, mask;
+#else
+  int i;
+  float inv[12];
+#endif
+
+  if (check_affine(dest, matrix) != 0)
+    return -1;
+
+  load_affine(m, matrix);
+
+#ifdef KYU_SSE
+  r0 = _mm_loadu_ps(&m[0]);
+  r1 = _mm_loadu_ps(&m[4]);
+  r2 = _mm_loadu_ps(&m[8]);
+
+  /* The columns of the transposed rotation are the rows of the source */
+  mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  c0 = _mm_and_ps(r0, mask);
+  c1 = _mm_and_ps(r1, mask);
+  c2 = _mm_and_ps(r2, mask);
+
+  o = translate_inverse(c0, c1, c2, r0, r1, r2);
+  _MM_TRANSPOSE4_PS(c0, c1, c2, o);
+
+  _mm_storeu_ps(&m[0], c0);
+  _mm_storeu_ps(&m[4], c1);
+  _mm_storeu_ps(&m[8], c2);
+#else
+  for (i = 0; i < 3; ++i)
+    {
+      inv[i * 4]     = m[i];
+      inv[i * 4 + 1] = m[4 + i];
+      inv[i * 4 + 2] = m[8 + i];
+      inv[i * 4 + 3] = -(m[i] * m[3] + m[4 + i] * m[7] + m[8 + i] * m[11]);
+    }
+
+  for (i = 0; i < 12; ++i)
+    m[i] = inv[i];
+#endif /* KYU_SSE */
+
+  store_affine(dest, m);
+
+  return 0;
+}
+
+int
+kyu_matrix_normal(kyu_matrix *dest, kyu_matrix *matrix)
+{
+  int i, j;
+  float m[16];
+#ifdef KYU_SSE
+  __m128 r0, r1, r2, c0, c1, c2, det;
+#else
+  float det;
+#endif
+
+  KYU_ASSERT(dest != NULL, "No destination matrix provided");
+  KYU_ASSERT(matrix != NULL, "No source matrix provided");
+  if (dest == NULL || matrix == NULL)
+    return -1;
+
+  KYU_ASSERT(matrix->width >= 3 && matrix->height >= 3,
+             "Matrix must be at least 3x3");
+  KYU_ASSERT(dest->width == 3 && dest->height == 3,
+             "Destination matrix must be 3x3");
+  if (matrix->width < 3 || matrix->height < 3
+      || dest->width != 3 || dest->height != 3)
+    return -1;
+
+  for (i = 0; i < 3; ++i)
+    {
+      for (j = 0; j < 3; ++j)
+        m[i * 4 + j] = matrix->t[i * matrix->width + j];
+      m[i * 4 + 3] = 0.f;
+    }
+
+#ifdef KYU_SSE
+  r0 = _mm_loadu_ps(&m[0]);
+  r1 = _mm_loadu_ps(&m[4]);
+  r2 = _mm_loadu_ps(&m[8]);
+
+  /* The rows of the inverse-transpose are the cofactors */
+  c0 = cross3(r1, r2);
+  c1 = cross3(r2, r0);
+  c2 = cross3(r0, r1);
+
+  det = hsum(_mm_mul_ps(r0, c0));
+  if (_mm_cvtss_f32(det) == 0.f)
+    return -1;
+
+  det = _mm_div_ps(_mm_set1_ps(1.f), det);
+  _mm_storeu_ps(&m[0], _mm_mul_ps(c0, det));
+  _mm_storeu_ps(&m[4], _mm_mul_ps(c1, det));
+  _mm_storeu_ps(&m[8], _mm_mul_ps(c2, det));
+#else
+  {
+    float n[12];
+
+    n[0]  = m[5] * m[10] - m[6] * m[9];
+    n[1]  = m[6] * m[8]  - m[4] * m[10];
+    n[2]  = m[4] * m[9]  - m[5] * m[8];
+    n[4]  = m[2] * m[9]  - m[1] * m[10];
+    n[5]  = m[0] * m[10] - m[2] * m[8];
+    n[6]  = m[1] * m[8]  - m[0] * m[9];
+    n[8]  = m[1] * m[6]  - m[2] * m[5];
+    n[9]  = m[2] * m[4]  - m[0] * m[6];
+    n[10] = m[0] * m[5]  - m[1] * m[4];
+
+    det = m[0] * n[0] + m[1] * n[1] + m[2] * n[2];
+    if (det == 0.f)
+      return -1;
+
+    det = 1.f / det;
+    for (i = 0; i < 12; ++i)
+      m[i] = n[i] * det;
+  }
+#endif /* KYU_SSE */
+
+  for (i = 0; i < 3; ++i)
+    {
+      for (j = 0; j < 3; ++j)
+        dest->t[i * 3 + j] = m[i * 4 + j];
+    }
+
+  return 0;
 }
 
 kyu_matrix *
@@ -418,11 +821,11 @@ kyu_matrix_translate_vec(kyu_vec *vec)
   if (vec == NULL)
     return ret;
 
-  ret = kyu_matrix_identity4x4();
+  ret = kyu_matrix_init4x4();
   if (ret == NULL)
     return ret;
 
-  kyu_matrix_setO(ret, vec);
+  kyu_matrix_set_translate_vec(ret, vec);
 
   return ret;
 }
@@ -430,19 +833,10 @@ kyu_matrix_translate_vec(kyu_vec *vec)
 kyu_matrix *
 kyu_matrix_rotateX(float angle)
 {
-  kyu_vec a, b;
-  kyu_matrix *ret = NULL;
-  float rad = RADF(angle);
-  
-  ret = kyu_matrix_identity4x4();
-  if (ret == NULL)
-    return ret;
-
-  a = kyu_vec_init(0.f,  cosf(rad), sinf(rad));
-  b = kyu_vec_init(0.f, -sinf(rad), cosf(rad));
+  kyu_matrix *ret = kyu_matrix_init4x4();
 
-  kyu_matrix_setJ(ret, &a);
-  kyu_matrix_setK(ret, &b);
+  if (ret != NULL)
+    kyu_matrix_set_rotateX(ret, angle);
 
   return ret;
 }
@@ -450,41 +844,105 @@ kyu_matrix_rotateX(float angle)
 kyu_matrix *
 kyu_matrix_rotateY(float angle)
 {
-  kyu_vec a, b;
-  kyu_matrix *ret = NULL;
-  float rad = RADF(angle);
-  
-  ret = kyu_matrix_identity4x4();
-  if (ret == NULL)
-    return ret;
-  
-  a = kyu_vec_init(cosf(rad), 0.f, -sinf(rad));
-  b = kyu_vec_init(sinf(rad), 0.f,  cosf(rad));
+  kyu_matrix *ret = kyu_matrix_init4x4();
 
-  kyu_matrix_setI(ret, &a);
-  kyu_matrix_setK(ret, &b);
+  if (ret != NULL)
+    kyu_matrix_set_rotateY(ret, angle);
 
   return ret;
 }
 
 kyu_matrix *
 kyu_matrix_rotateZ(float angle)
+{
+  kyu_matrix *ret = kyu_matrix_init4x4();
+
+  if (ret != NULL)
+    kyu_matrix_set_rotateZ(ret, angle);
+
+  return ret;
+}
+
+void
+kyu_matrix_set_identity(kyu_matrix *matrix)
+{
+  int i, j;
+
+  KYU_ASSERT(matrix != NULL, "No matrix provided");
+  if (matrix == NULL)
+    return;
+
+  for (i = 0; i < matrix->height; ++i)
+    {
+      for (j = 0; j < matrix->width; ++j)
+        matrix->t[i * matrix->width + j] = (i == j) ? 1.f : 0.f;
+    }
+}
+
+void
+kyu_matrix_set_translate(kyu_matrix *matrix, float x, float y, float z)
+{
+  kyu_vec v = kyu_point_init(x, y, z);
+  kyu_matrix_set_translate_vec(matrix, &v);
+}
+
+void
+kyu_matrix_set_translate_vec(kyu_matrix *matrix, kyu_vec *vec)
+{
+  KYU_ASSERT(vec != NULL, "No vector provided");
+  if (vec == NULL)
+    return;
+
+  kyu_matrix_set_identity(matrix);
+  kyu_matrix_setO(matrix, vec);
+}
+
+void
+kyu_matrix_set_rotateX(kyu_matrix *matrix, float angle)
 {
   kyu_vec a, b;
-  kyu_matrix *ret = NULL;
-  float rad = RADF(angle);
+  float s, c;
+
+  kyu_matrix_set_identity(matrix);
+
+  kyu_sincos(RADF(angle), &s, &c);
+  a = kyu_vec_init(0.f,  c, s);
+  b = kyu_vec_init(0.f, -s, c);
+
+  kyu_matrix_setJ(matrix, &a);
+  kyu_matrix_setK(matrix, &b);
+}
+
+void
+kyu_matrix_set_rotateY(kyu_matrix *matrix, float angle)
+{
+  kyu_vec a, b;
+  float s, c;
+
+  kyu_matrix_set_identity(matrix);
   
-  ret = kyu_matrix_identity4x4();
-  if (ret == NULL)
-    return ret;
+  kyu_sincos(RADF(angle), &s, &c);
+  a = kyu_vec_init(c, 0.f, -s);
+  b = kyu_vec_init(s, 0.f,  c);
 
-  a = kyu_vec_init( cosf(rad), sinf(rad), 0.f);
-  b = kyu_vec_init(-sinf(rad), cosf(rad), 0.f);
+  kyu_matrix_setI(matrix, &a);
+  kyu_matrix_setK(matrix, &b);
+}
 
-  kyu_matrix_setI(ret, &a);
-  kyu_matrix_setJ(ret, &b);
+void
+kyu_matrix_set_rotateZ(kyu_matrix *matrix, float angle)
+{
+  kyu_vec a, b;
+  float s, c;
 
-  return ret;
+  kyu_matrix_set_identity(matrix);
+
+  kyu_sincos(RADF(angle), &s, &c);
+  a = kyu_vec_init( c, s, 0.f);
+  b = kyu_vec_init(-s, c, 0.f);
+
+  kyu_matrix_setI(matrix, &a);
+  kyu_matrix_setJ(matrix, &b);
 }
 
 void
@@ -518,3 +976,127 @@ kyu_matrix_fprint(FILE *stream, kyu_matrix *matrix)
     }
   fprintf(stream, "]\n");
 }
+
+/* Stack when it fits, then the frame arena, the heap as a last resort */
+static float *
+scratch_alloc(float *stack, int count)
+{
+  float *tab;
+
+  if (count <= KYU_MATRIX_STACK)
+    return stack;
+
+  if (kyu_frame_arena() != NULL)
+    return KYU_FRAME_NEW(float, count);
+
+  tab = (float *)kyu_malloc(count * sizeof(float), KYU_MEMORY_MATH);
+  KYU_ASSERT(tab != NULL, "Can't allocate memory for the temporary matrix");
+
+  return tab;
+}
+
+static void
+scratch_free(float *stack, float *tab)
+{
+  if (tab != stack && !kyu_frame_owns(tab))
+    kyu_free(tab);
+}
+
+static int
+check_affine(kyu_matrix *dest, kyu_matrix *matrix)
+{
+  KYU_ASSERT(dest != NULL, "No destination matrix provided");
+  KYU_ASSERT(matrix != NULL, "No source matrix provided");
+  if (dest == NULL || matrix == NULL)
+    return -1;
+
+  KYU_ASSERT(matrix->width == 4 && (matrix->height == 3 || matrix->height == 4),
+             "Matrix must be 3x4 or 4x4");
+  KYU_ASSERT(dest->width == matrix->width && dest->height == matrix->height,
+             "Size of matrices doesn't match");
+  if (matrix->width != 4 || (matrix->height != 3 && matrix->height != 4)
+      || dest->width != matrix->width || dest->height != matrix->height)
+    return -1;
+
+  return 0;
+}
+
+static void
+load_affine(float *m, kyu_matrix *matrix)
+{
+  int i;
+
+  for (i = 0; i < 12; ++i)
+    m[i] = matrix->t[i];
+}
+
+static void
+store_affine(kyu_matrix *dest, const float *m)
+{
+  int i;
+
+  for (i = 0; i < 12; ++i)
+    dest->t[i] = m[i];
+
+  if (dest->height == 4)
+    {
+      dest->t[12] = 0.f;
+      dest->t[13] = 0.f;
+      dest->t[14] = 0.f;
+      dest->t[15] = 1.f;
+    }
+}
+
+#ifdef KYU_SSE
+static __m128
+hsum(__m128 v)
+{
+  v = _mm_add_ps(v, KYU_SWIZZLE(v, 2, 3, 0, 1));
+  return _mm_add_ps(v, KYU_SWIZZLE(v, 1, 0, 3, 2));
+}
+
+static __m128
+cross3(__m128 a, __m128 b)
+{
+  return _mm_sub_ps(_mm_mul_ps(KYU_SWIZZLE(a, 1, 2, 0, 3), KYU_SWIZZLE(b, 2, 0, 1, 3)),
+                    _mm_mul_ps(KYU_SWIZZLE(a, 2, 0, 1, 3), KYU_SWIZZLE(b, 1, 2, 0, 3)));
+}
+
+/* -(c0 * r0.w + c1 * r1.w + c2 * r2.w) with a w lane of 1 */
+static __m128
+translate_inverse(__m128 c0, __m128 c1, __m128 c2,
+                  __m128 r0, __m128 r1, __m128 r2)
+{
+  __m128 o;
+
+  o = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, KYU_SWIZZLE(r0, 3, 3, 3, 3)),
+                            _mm_mul_ps(c1, KYU_SWIZZLE(r1, 3, 3, 3, 3))),
+                 _mm_mul_ps(c2, KYU_SWIZZLE(r2, 3, 3, 3, 3)));
+  o = _mm_sub_ps(_mm_setzero_ps(), o);
+  o = _mm_and_ps(o, _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)));
+
+  return _mm_or_ps(o, _mm_setr_ps(0.f, 0.f, 0.f, 1.f));
+}
+
+/* 2x2 row-major products: A * B, A# * B and A * B# (# is the adjugate) */
+static __m128
+mat2_mult(__m128 a, __m128 b)
+{
+  return _mm_add_ps(_mm_mul_ps(a, KYU_SWIZZLE(b, 0, 3, 0, 3)),
+                    _mm_mul_ps(KYU_SWIZZLE(a, 1, 0, 3, 2), KYU_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+static __m128
+mat2_adj_mult(__m128 a, __m128 b)
+{
+  return _mm_sub_ps(_mm_mul_ps(KYU_SWIZZLE(a, 3, 3, 0, 0), b),
+                    _mm_mul_ps(KYU_SWIZZLE(a, 1, 1, 2, 2), KYU_SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+static __m128
+mat2_mult_adj(__m128 a, __m128 b)
+{
+  return _mm_sub_ps(_mm_mul_ps(a, KYU_SWIZZLE(b, 3, 0, 3, 0)),
+                    _mm_mul_ps(KYU_SWIZZLE(a, 1, 0, 3, 2), KYU_SWIZZLE(b, 2, 1, 2, 1)));
+}
+#endif /* KYU_SSE */
@@ -0,0 +1,364 @@
+/* ray -- packet ray-triangle intersection
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/math/ray.h"
+#include "kyu/graphics/mesh.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/memory.h"
+#include "math/simd.h"
+
+#include <stdlib.h>
+
+#define RAY_EPSILON 1e-7f
+
+#ifdef KYU_SSE
+static int intersect4_sse(kyu_ray *ray, kyu_triangle_packet *packet, int lane,
+                          float t_max, float *t);
+#endif /* KYU_SSE */
+
+kyu_ray
+kyu_ray_init(kyu_point *origin, kyu_vec *direction)
+{
+  kyu_ray ret;
+
+  KYU_ASSERT(origin != NULL, "No origin provided");
+  KYU_ASSERT(direction != NULL, "No direction provided");
+
+  ret.origin    = (origin != NULL) ? *origin : kyu_point_init(0.f, 0.f, 0.f);
+  ret.direction = (direction != NULL) ? *direction : kyu_vec_init(0.f, 0.f, 0.f);
+
+  return ret;
+}
+
+kyu_ray_mesh *
+kyu_ray_mesh_init(kyu_mesh *mesh)
+{
+  int i, j, lane;
+  kyu_ray_mesh *ret;
+  kyu_triangle_packet *packet;
+  kyu_point *v0, *v1, *v2;
+
+  KYU_ASSERT(mesh != NULL, "No mesh provided");
+  if (mesh == NULL)
+    return NULL;
+
+  ret = (kyu_ray_mesh *)kyu_malloc(sizeof(kyu_ray_mesh), KYU_MEMORY_MATH);
+  KYU_ASSERT(ret != NULL, "Can't allocate memory for the ray mesh");
+  if (ret == NULL)
+    return NULL;
+
+  ret->nb_triangles = mesh->nb_triangles;
+  ret->nb_packets   = (mesh->nb_triangles + KYU_RAY_PACKET - 1) / KYU_RAY_PACKET;
+  ret->packets      = (kyu_triangle_packet *)kyu_calloc(MAX(ret->nb_packets, 1),
+                                                    sizeof(kyu_triangle_packet), KYU_MEMORY_MATH);
+  KYU_ASSERT(ret->packets != NULL, "Can't allocate memory for the triangle packets");
+  if (ret->packets == NULL)
+    {
+      kyu_free(ret);
+      return NULL;
+    }
+
+  for (i = 0; i < mesh->nb_triangles; ++i)
+    {
+      packet = &ret->packets[i / KYU_RAY_PACKET];
+      lane   = i % KYU_RAY_PACKET;
+
+      v0 = &mesh->vertices[mesh->triangles[i].vertices[0]];
+      v1 = &mesh->vertices[mesh->triangles[i].vertices[1]];
+      v2 = &mesh->vertices[mesh->triangles[i].vertices[2]];
+
+      for (j = 0; j < 3; ++j)
+        {
+          float a = (&v0->x)[j];
+
+          packet->v0[j][lane] = a;
+          packet->e1[j][lane] = (&v1->x)[j] - a;
+          packet->e2[j][lane] = (&v2->x)[j] - a;
+        }
+    }
+
+  return ret;
+}
+
+void
+kyu_ray_mesh_release(kyu_ray_mesh *mesh)
+{
+  KYU_ASSERT(mesh != NULL, "No ray mesh provided");
+
+  if (mesh != NULL)
+    {
+      kyu_free(mesh->packets);
+      kyu_free(mesh);
+    }
+}
+
+int
+kyu_ray_intersect_packet(kyu_ray *ray, kyu_triangle_packet *packet,
+                         float t_max, float *t)
+{
+#if defined(KYU_AVX2)
+  return kyu_ray_intersect_packet_avx2(ray, packet, t_max, t);
+#elif defined(KYU_SSE)
+  return kyu_ray_intersect_packet_sse(ray, packet, t_max, t);
+#else
+  return kyu_ray_intersect_packet_scalar(ray, packet, t_max, t);
+#endif
+}
+
+int
+kyu_ray_intersect_packet_scalar(kyu_ray *ray, kyu_triangle_packet *packet,
+                                float t_max, float *t)
+{
+  int i, mask;
+  float px, py, pz, sx, sy, sz, qx, qy, qz;
+  float det, inv, u, v, d;
+  const kyu_vec *dir;
+
+  KYU_ASSERT(ray != NULL, "No ray provided");
+  KYU_ASSERT(packet != NULL, "No triangle packet provided");
+  KYU_ASSERT(t != NULL, "No distance array provided");
+  if (ray == NULL || packet == NULL || t == NULL)
+    return 0;
+
+  dir  = &ray->direction;
+  mask = 0;
+  for (i = 0; i < KYU_RAY_PACKET; ++i)
+    {
+      t[i] = t_max;
+
+      px = dir->y * packet->e2[2][i] - dir->z * packet->e2[1][i];
+      py = dir->z * packet->e2[0][i] - dir->x * packet->e2[2][i];
+      pz = dir->x * packet->e2[1][i] - dir->y * packet->e2[0][i];
+
+      det = packet->e1[0][i] * px + packet->e1[1][i] * py + packet->e1[2][i] * pz;
+      if (fabsf(det) <= RAY_EPSILON)
+        continue;
+
+      inv = 1.f / det;
+
+      sx = ray->origin.x - packet->v0[0][i];
+      sy = ray->origin.y - packet->v0[1][i];
+      sz = ray->origin.z - packet->v0[2][i];
+
+      u = (sx * px + sy * py + sz * pz) * inv;
+
+      qx = sy * packet->e1[2][i] - sz * packet->e1[1][i];
+      qy = sz * packet->e1[0][i] - sx * packet->e1[2][i];
+      qz = sx * packet->e1[1][i] - sy * packet->e1[0][i];
+
+      v = (dir->x * qx + dir->y * qy + dir->z * qz) * inv;
+      d = (packet->e2[0][i] * qx + packet->e2[1][i] * qy + packet->e2[2][i] * qz) * inv;
+
+      if (u >= 0.f && v >= 0.f && u + v <= 1.f && d > RAY_EPSILON && d < t_max)
+        {
+          t[i] = d;
+          mask |= 1 << i;
+        }
+    }
+
+  return mask;
+}
+
+int
+kyu_ray_intersect_packet_sse(kyu_ray *ray, kyu_triangle_packet *packet,
+                             float t_max, float *t)
+{
+#ifdef KYU_SSE
+  int i, mask;
+
+  KYU_ASSERT(ray != NULL, "No ray provided");
+  KYU_ASSERT(packet != NULL, "No triangle packet provided");
+  KYU_ASSERT(t != NULL, "No distance array provided");
+  if (ray == NULL || packet == NULL || t == NULL)
+    return 0;
+
+  mask = 0;
+  for (i = 0; i < KYU_RAY_PACKET; i += 4)
+    mask |= intersect4_sse(ray, packet, i, t_max, t) << i;
+
+  return mask;
+#else
+  return kyu_ray_intersect_packet_scalar(ray, packet, t_max, t);
+#endif /* KYU_SSE */
+}
+
+int
+kyu_ray_intersect_packet_avx2(kyu_ray *ray, kyu_triangle_packet *packet,
+                              float t_max, float *t)
+{
+#ifdef KYU_AVX2
+  __m256 dx, dy, dz, e1x, e1y, e1z, e2x, e2y, e2z;
+  __m256 px, py, pz, sx, sy, sz, qx, qy, qz;
+  __m256 det, inv, u, v, d, tmax, zero, hit;
+
+  KYU_ASSERT(ray != NULL, "No ray provided");
+  KYU_ASSERT(packet != NULL, "No triangle packet provided");
+  KYU_ASSERT(t != NULL, "No distance array provided");
+  if (ray == NULL || packet == NULL || t == NULL)
+    return 0;
+
+  dx = _mm256_set1_ps(ray->direction.x);
+  dy = _mm256_set1_ps(ray->direction.y);
+  dz = _mm256_set1_ps(ray->direction.z);
+
+  e1x = _mm256_loadu_ps(packet->e1[0]);
+  e1y = _mm256_loadu_ps(packet->e1[1]);
+  e1z = _mm256_loadu_ps(packet->e1[2]);
+  e2x = _mm256_loadu_ps(packet->e2[0]);
+  e2y = _mm256_loadu_ps(packet->e2[1]);
+  e2z = _mm256_loadu_ps(packet->e2[2]);
+
+  px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+  py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+  pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+
+  det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)),
+                      _mm256_mul_ps(e1z, pz));
+  inv = _mm256_div_ps(_mm256_set1_ps(1.f), det);
+
+  sx = _mm256_sub_ps(_mm256_set1_ps(ray->origin.x), _mm256_loadu_ps(packet->v0[0]));
+  sy = _mm256_sub_ps(_mm256_set1_ps(ray->origin.y), _mm256_loadu_ps(packet->v0[1]));
+  sz = _mm256_sub_ps(_mm256_set1_ps(ray->origin.z), _mm256_loadu_ps(packet->v0[2]));
+
+  u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)),
+                                  _mm256_mul_ps(sz, pz)),
+                    inv);
+
+  qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+  qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+  qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+
+  v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)),
+                                  _mm256_mul_ps(dz, qz)),
+                    inv);
+  d = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)),
+                                  _mm256_mul_ps(e2z, qz)),
+                    inv);
+
+  zero = _mm256_setzero_ps();
+  tmax = _mm256_set1_ps(t_max);
+
+  hit = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.f), det),
+                      _mm256_set1_ps(RAY_EPSILON), _CMP_GT_OQ);
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.f), _CMP_LE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(d, _mm256_set1_ps(RAY_EPSILON), _CMP_GT_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(d, tmax, _CMP_LT_OQ));
+
+  _mm256_storeu_ps(t, _mm256_blendv_ps(tmax, d, hit));
+
+  return _mm256_movemask_ps(hit);
+#else
+  return kyu_ray_intersect_packet_sse(ray, packet, t_max, t);
+#endif /* KYU_AVX2 */
+}
+
+int
+kyu_ray_intersect_mesh(kyu_ray *ray, kyu_ray_mesh *mesh, float t_max, float *t)
+{
+  int i, lane, mask, ret;
+  float packet_t[KYU_RAY_PACKET];
+
+  KYU_ASSERT(ray != NULL, "No ray provided");
+  KYU_ASSERT(mesh != NULL, "No ray mesh provided");
+  if (ray == NULL || mesh == NULL)
+    return -1;
+
+  ret = -1;
+  for (i = 0; i < mesh->nb_packets; ++i)
+    {
+      mask = kyu_ray_intersect_packet(ray, &mesh->packets[i], t_max, packet_t);
+
+      for (lane = 0; mask != 0; ++lane, mask >>= 1)
+        {
+          if ((mask & 1) && packet_t[lane] < t_max)
+            {
+              t_max = packet_t[lane];
+              ret = i * KYU_RAY_PACKET + lane;
+            }
+        }
+    }
+
+  if (ret >= 0 && t != NULL)
+    *t = t_max;
+
+  return ret;
+}
+
+#ifdef KYU_SSE
+static int
+intersect4_sse(kyu_ray *ray, kyu_triangle_packet *packet, int lane,
+               float t_max, float *t)
+{
+  __m128 dx, dy, dz, e1x, e1y, e1z, e2x, e2y, e2z;
+  __m128 px, py, pz, sx, sy, sz, qx, qy, qz;
+  __m128 det, inv, u, v, d, tmax, zero, hit;
+
+  dx = _mm_set1_ps(ray->direction.x);
+  dy = _mm_set1_ps(ray->direction.y);
+  dz = _mm_set1_ps(ray->direction.z);
+
+  e1x = _mm_loadu_ps(&packet->e1[0][lane]);
+  e1y = _mm_loadu_ps(&packet->e1[1][lane]);
+  e1z = _mm_loadu_ps(&packet->e1[2][lane]);
+  e2x = _mm_loadu_ps(&packet->e2[0][lane]);
+  e2y = _mm_loadu_ps(&packet->e2[1][lane]);
+  e2z = _mm_loadu_ps(&packet->e2[2][lane]);
+
+  px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+  py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+  pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+  det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)),
+                   _mm_mul_ps(e1z, pz));
+  inv = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+  sx = _mm_sub_ps(_mm_set1_ps(ray->origin.x), _mm_loadu_ps(&packet->v0[0][lane]));
+  sy = _mm_sub_ps(_mm_set1_ps(ray->origin.y), _mm_loadu_ps(&packet->v0[1][lane]));
+  sz = _mm_sub_ps(_mm_set1_ps(ray->origin.z), _mm_loadu_ps(&packet->v0[2][lane]));
+
+  u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)),
+                            _mm_mul_ps(sz, pz)),
+                 inv);
+
+  qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+  qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+  qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+  v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+                            _mm_mul_ps(dz, qz)),
+                 inv);
+  d = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+                            _mm_mul_ps(e2z, qz)),
+                 inv);
+
+  zero = _mm_setzero_ps();
+  tmax = _mm_set1_ps(t_max);
+
+  hit = _mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.f), det), _mm_set1_ps(RAY_EPSILON));
+  hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+  hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+  hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f)));
+  hit = _mm_and_ps(hit, _mm_cmpgt_ps(d, _mm_set1_ps(RAY_EPSILON)));
+  hit = _mm_and_ps(hit, _mm_cmplt_ps(d, tmax));
+
+  _mm_storeu_ps(&t[lane], _mm_or_ps(_mm_and_ps(hit, d), _mm_andnot_ps(hit, tmax)));
+
+  return _mm_movemask_ps(hit);
+}
+#endif /* KYU_SSE */
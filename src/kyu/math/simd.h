@@ -0,0 +1,45 @@
+/* simd -- instruction set selection for the math kernels
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef KYU_SIMD_H
+#define KYU_SIMD_H
+
+#include "kyu/core/utils.h"
+
+/* KYU_SSE is defined when the SSE2 kernels can be used and KYU_AVX2 when
+   the library is built with KYU_USE_AVX2, every other target (PS2
+   included) takes the scalar paths. Define KYU_NO_SIMD to force the
+   scalar code. */
+#if !defined(KYU_NO_SIMD) && !defined(__KYU_PS2__)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KYU_SSE
+#include <emmintrin.h>
+#endif /* __SSE2__ || _M_X64 || _M_IX86_FP >= 2 */
+
+#if defined(KYU_SSE) && defined(__AVX2__)
+#define KYU_AVX2
+#include <immintrin.h>
+#endif /* KYU_SSE && __AVX2__ */
+#endif /* !KYU_NO_SIMD && !__KYU_PS2__ */
+
+#ifdef KYU_SSE
+#define KYU_SHUFFLE(A, B, X, Y, Z, W) \
+  _mm_shuffle_ps((A), (B), _MM_SHUFFLE((W), (Z), (Y), (X)))
+#define KYU_SWIZZLE(A, X, Y, Z, W) KYU_SHUFFLE(A, A, X, Y, Z, W)
+#endif /* KYU_SSE */
+
+#endif /* KYU_SIMD_H */
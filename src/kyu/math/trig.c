@@ -0,0 +1,165 @@
+/* trig -- fast trigonometric functions
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/math/trig.h"
+#include "kyu/core/utils.h"
+#include "math/simd.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+/* 4 / pi and pi / 4 split in three parts for an exact reduction */
+#define FOPI 1.27323954473516f
+#define DP1  0.78515625f
+#define DP2  2.4187564849853515625e-4f
+#define DP3  3.77489497744594108e-8f
+
+/* Minimax coefficients on [-pi/4, pi/4] */
+#define SIN_P0 -1.9515295891e-4f
+#define SIN_P1  8.3321608736e-3f
+#define SIN_P2 -1.6666654611e-1f
+#define COS_P0  2.443315711809948e-5f
+#define COS_P1 -1.388731625493765e-3f
+#define COS_P2  4.166664568298827e-2f
+
+void
+kyu_sincos(float x, float *s, float *c)
+{
+  int j, sign_sin;
+  float y, z, ps, pc;
+
+  KYU_ASSERT(s != NULL, "No sine output provided");
+  KYU_ASSERT(c != NULL, "No cosine output provided");
+  if (s == NULL || c == NULL)
+    return;
+
+  sign_sin = (x < 0.f);
+  x = fabsf(x);
+
+  if (!(x <= KYU_SINCOS_RANGE))
+    {
+      *s = sinf(sign_sin ? -x : x);
+      *c = cosf(x);
+      return;
+    }
+
+  /* Octant, rounded to an even one so that the reduced angle is in
+     [-pi/4, pi/4] */
+  j = (int)(x * FOPI);
+  j = (j + 1) & ~1;
+  y = (float)j;
+
+  x = ((x - y * DP1) - y * DP2) - y * DP3;
+  z = x * x;
+
+  pc = ((COS_P0 * z + COS_P1) * z + COS_P2) * z * z - 0.5f * z + 1.f;
+  ps = ((SIN_P0 * z + SIN_P1) * z + SIN_P2) * z * x + x;
+
+  if (j & 2)
+    {
+      *s = pc;
+      *c = ps;
+    }
+  else
+    {
+      *s = ps;
+      *c = pc;
+    }
+
+  if (j & 4)
+    sign_sin ^= 1;
+
+  if (sign_sin)
+    *s = -*s;
+
+  if (((j - 2) & 4) == 0)
+    *c = -*c;
+}
+
+void
+kyu_sincos4(const float *x, float *s, float *c)
+{
+#ifdef KYU_SSE
+  __m128 v, y, z, ps, pc, sign_sin, sign_cos, poly, sign_mask;
+  __m128i j, k;
+  float angles[4];
+  int outside, i;
+
+  KYU_ASSERT(x != NULL, "No angles provided");
+  KYU_ASSERT(s != NULL, "No sine output provided");
+  KYU_ASSERT(c != NULL, "No cosine output provided");
+  if (x == NULL || s == NULL || c == NULL)
+    return;
+
+  sign_mask = _mm_set1_ps(-0.f);
+
+  v = _mm_loadu_ps(x);
+  _mm_storeu_ps(angles, v);
+  sign_sin = _mm_and_ps(v, sign_mask);
+  v = _mm_andnot_ps(sign_mask, v);
+
+  /* The octant doesn't fit an int32 far enough out, NaN included */
+  outside = _mm_movemask_ps(_mm_cmpnle_ps(v, _mm_set1_ps(KYU_SINCOS_RANGE)));
+
+  j = _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(FOPI)));
+  j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+  y = _mm_cvtepi32_ps(j);
+
+  /* Sign swaps and polynomial selection, same as the scalar version */
+  k = _mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29);
+  sign_sin = _mm_xor_ps(sign_sin, _mm_castsi128_ps(k));
+
+  k = _mm_sub_epi32(j, _mm_set1_epi32(2));
+  k = _mm_slli_epi32(_mm_andnot_si128(k, _mm_set1_epi32(4)), 29);
+  sign_cos = _mm_castsi128_ps(k);
+
+  k = _mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128());
+  poly = _mm_castsi128_ps(k);
+
+  v = _mm_sub_ps(v, _mm_mul_ps(y, _mm_set1_ps(DP1)));
+  v = _mm_sub_ps(v, _mm_mul_ps(y, _mm_set1_ps(DP2)));
+  v = _mm_sub_ps(v, _mm_mul_ps(y, _mm_set1_ps(DP3)));
+  z = _mm_mul_ps(v, v);
+
+  pc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0), z), _mm_set1_ps(COS_P1));
+  pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(COS_P2));
+  pc = _mm_mul_ps(_mm_mul_ps(pc, z), z);
+  pc = _mm_add_ps(_mm_sub_ps(pc, _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.f));
+
+  ps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0), z), _mm_set1_ps(SIN_P1));
+  ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(SIN_P2));
+  ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), v), v);
+
+  _mm_storeu_ps(s, _mm_xor_ps(_mm_or_ps(_mm_and_ps(poly, ps), _mm_andnot_ps(poly, pc)),
+                              sign_sin));
+  _mm_storeu_ps(c, _mm_xor_ps(_mm_or_ps(_mm_and_ps(poly, pc), _mm_andnot_ps(poly, ps)),
+                              sign_cos));
+
+  for (i = 0; outside != 0 && i < 4; ++i)
+    if (outside & (1 << i))
+      kyu_sincos(angles[i], &s[i], &c[i]);
+#else
+  int i;
+
+  KYU_ASSERT(x != NULL, "No angles provided");
+  if (x == NULL)
+    return;
+
+  for (i = 0; i < 4; ++i)
+    kyu_sincos(x[i], &s[i], &c[i]);
+#endif /* KYU_SSE */
+}
@@ -0,0 +1,451 @@
+/* vector_array -- SIMD kernels for arrays of vectors
+
+   Copyright (C) 2021 Jean-Baptiste Loutfalla <jb.loutfalla@orange.fr>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+#include "kyu/math/vector_array.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/frame.h"
+#include "math/simd.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define CHECK_ARRAYS(A, B, C)                               \
+  {                                                         \
+    KYU_ASSERT((A) != NULL && (B) != NULL && (C) != NULL,   \
+               "No array provided");                        \
+    if ((A) == NULL || (B) == NULL || (C) == NULL)          \
+      return;                                               \
+  }
+
+#define CHECK_SOA(V)                                                    \
+  {                                                                     \
+    KYU_ASSERT((V) != NULL && (V)->x != NULL && (V)->y != NULL          \
+               && (V)->z != NULL, "No SoA vectors provided");           \
+    if ((V) == NULL || (V)->x == NULL || (V)->y == NULL || (V)->z == NULL) \
+      return;                                                           \
+  }
+
+#ifdef KYU_SSE
+/* Keeps x, y and z, clears w like kyu_vec_init does */
+#define XYZ_MASK _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0))
+
+static __m128 dot4(__m128 ax, __m128 ay, __m128 az,
+                   __m128 bx, __m128 by, __m128 bz);
+#endif /* KYU_SSE */
+
+void
+kyu_vec_array_add(kyu_vec *dest, kyu_vec *a, kyu_vec *b, int count)
+{
+  int i = 0;
+
+  CHECK_ARRAYS(dest, a, b);
+
+#ifdef KYU_SSE
+  for (; i < count; ++i)
+    _mm_storeu_ps(&dest[i].x, _mm_and_ps(_mm_add_ps(_mm_loadu_ps(&a[i].x),
+                                                    _mm_loadu_ps(&b[i].x)),
+                                         XYZ_MASK));
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    dest[i] = kyu_vec_add(&a[i], &b[i]);
+}
+
+void
+kyu_vec_array_sub(kyu_vec *dest, kyu_vec *a, kyu_vec *b, int count)
+{
+  int i = 0;
+
+  CHECK_ARRAYS(dest, a, b);
+
+#ifdef KYU_SSE
+  for (; i < count; ++i)
+    _mm_storeu_ps(&dest[i].x, _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(&a[i].x),
+                                                    _mm_loadu_ps(&b[i].x)),
+                                         XYZ_MASK));
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    dest[i] = kyu_vec_sub(&a[i], &b[i]);
+}
+
+void
+kyu_vec_array_mult(kyu_vec *dest, float a, kyu_vec *b, int count)
+{
+  int i = 0;
+
+  CHECK_ARRAYS(dest, b, b);
+
+#ifdef KYU_SSE
+  {
+    __m128 s = _mm_set1_ps(a);
+
+    /* w is cleared after the product, 0 * inf would be NaN */
+    for (; i < count; ++i)
+      _mm_storeu_ps(&dest[i].x, _mm_and_ps(_mm_mul_ps(s, _mm_loadu_ps(&b[i].x)),
+                                           XYZ_MASK));
+  }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    dest[i] = kyu_vec_mult(a, &b[i]);
+}
+
+void
+kyu_vec_array_dot(float *dest, kyu_vec *a, kyu_vec *b, int count)
+{
+  int i = 0;
+
+  CHECK_ARRAYS(dest, a, b);
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    {
+      __m128 ax = _mm_loadu_ps(&a[i].x);
+      __m128 ay = _mm_loadu_ps(&a[i + 1].x);
+      __m128 az = _mm_loadu_ps(&a[i + 2].x);
+      __m128 aw = _mm_loadu_ps(&a[i + 3].x);
+      __m128 bx = _mm_loadu_ps(&b[i].x);
+      __m128 by = _mm_loadu_ps(&b[i + 1].x);
+      __m128 bz = _mm_loadu_ps(&b[i + 2].x);
+      __m128 bw = _mm_loadu_ps(&b[i + 3].x);
+
+      _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+      _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+      _mm_storeu_ps(&dest[i], dot4(ax, ay, az, bx, by, bz));
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    dest[i] = dot(&a[i], &b[i]);
+}
+
+void
+kyu_vec_array_cross(kyu_vec *dest, kyu_vec *a, kyu_vec *b, int count)
+{
+  int i = 0;
+
+  CHECK_ARRAYS(dest, a, b);
+
+#ifdef KYU_SSE
+  for (; i < count; ++i)
+    {
+      __m128 va = _mm_loadu_ps(&a[i].x);
+      __m128 vb = _mm_loadu_ps(&b[i].x);
+      __m128 r;
+
+      r = _mm_sub_ps(_mm_mul_ps(KYU_SWIZZLE(va, 1, 2, 0, 3), KYU_SWIZZLE(vb, 2, 0, 1, 3)),
+                     _mm_mul_ps(KYU_SWIZZLE(va, 2, 0, 1, 3), KYU_SWIZZLE(vb, 1, 2, 0, 3)));
+      _mm_storeu_ps(&dest[i].x, _mm_and_ps(r, XYZ_MASK));
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    dest[i] = cross(&a[i], &b[i]);
+}
+
+void
+kyu_vec_array_normalize(kyu_vec *dest, kyu_vec *v, int count)
+{
+  int i = 0;
+
+  CHECK_ARRAYS(dest, v, v);
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    {
+      __m128 r0 = _mm_loadu_ps(&v[i].x);
+      __m128 r1 = _mm_loadu_ps(&v[i + 1].x);
+      __m128 r2 = _mm_loadu_ps(&v[i + 2].x);
+      __m128 r3 = _mm_loadu_ps(&v[i + 3].x);
+      __m128 x = r0, y = r1, z = r2, w = r3, l;
+
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+      l = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(dot4(x, y, z, x, y, z)));
+
+      _mm_storeu_ps(&dest[i].x,
+                    _mm_and_ps(_mm_mul_ps(KYU_SWIZZLE(l, 0, 0, 0, 0), r0), XYZ_MASK));
+      _mm_storeu_ps(&dest[i + 1].x,
+                    _mm_and_ps(_mm_mul_ps(KYU_SWIZZLE(l, 1, 1, 1, 1), r1), XYZ_MASK));
+      _mm_storeu_ps(&dest[i + 2].x,
+                    _mm_and_ps(_mm_mul_ps(KYU_SWIZZLE(l, 2, 2, 2, 2), r2), XYZ_MASK));
+      _mm_storeu_ps(&dest[i + 3].x,
+                    _mm_and_ps(_mm_mul_ps(KYU_SWIZZLE(l, 3, 3, 3, 3), r3), XYZ_MASK));
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    dest[i] = normalize(&v[i]);
+}
+
+void
+kyu_vec_array_length(float *dest, kyu_vec *v, int count)
+{
+  int i = 0;
+
+  CHECK_ARRAYS(dest, v, v);
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    {
+      __m128 x = _mm_loadu_ps(&v[i].x);
+      __m128 y = _mm_loadu_ps(&v[i + 1].x);
+      __m128 z = _mm_loadu_ps(&v[i + 2].x);
+      __m128 w = _mm_loadu_ps(&v[i + 3].x);
+
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+      _mm_storeu_ps(&dest[i], _mm_sqrt_ps(dot4(x, y, z, x, y, z)));
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    dest[i] = length(&v[i]);
+}
+
+int
+kyu_vec_soa_frame_init(kyu_vec_soa *soa, int count)
+{
+  float *tab;
+  size_t stride;
+
+  KYU_ASSERT(soa != NULL, "No structure of arrays provided");
+  if (soa == NULL)
+    return -1;
+
+  /* Each array starts on a SIMD boundary */
+  stride = ((size_t)count + 3) & ~(size_t)3;
+  tab = KYU_FRAME_NEW(float, 3 * stride);
+  if (tab == NULL)
+    return -1;
+
+  soa->x = tab;
+  soa->y = tab + stride;
+  soa->z = tab + 2 * stride;
+
+  return 0;
+}
+
+void
+kyu_vec_soa_add(kyu_vec_soa *dest, kyu_vec_soa *a, kyu_vec_soa *b, int count)
+{
+  int i = 0;
+
+  CHECK_SOA(dest);
+  CHECK_SOA(a);
+  CHECK_SOA(b);
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    {
+      _mm_storeu_ps(&dest->x[i], _mm_add_ps(_mm_loadu_ps(&a->x[i]), _mm_loadu_ps(&b->x[i])));
+      _mm_storeu_ps(&dest->y[i], _mm_add_ps(_mm_loadu_ps(&a->y[i]), _mm_loadu_ps(&b->y[i])));
+      _mm_storeu_ps(&dest->z[i], _mm_add_ps(_mm_loadu_ps(&a->z[i]), _mm_loadu_ps(&b->z[i])));
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    {
+      dest->x[i] = a->x[i] + b->x[i];
+      dest->y[i] = a->y[i] + b->y[i];
+      dest->z[i] = a->z[i] + b->z[i];
+    }
+}
+
+void
+kyu_vec_soa_sub(kyu_vec_soa *dest, kyu_vec_soa *a, kyu_vec_soa *b, int count)
+{
+  int i = 0;
+
+  CHECK_SOA(dest);
+  CHECK_SOA(a);
+  CHECK_SOA(b);
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    {
+      _mm_storeu_ps(&dest->x[i], _mm_sub_ps(_mm_loadu_ps(&a->x[i]), _mm_loadu_ps(&b->x[i])));
+      _mm_storeu_ps(&dest->y[i], _mm_sub_ps(_mm_loadu_ps(&a->y[i]), _mm_loadu_ps(&b->y[i])));
+      _mm_storeu_ps(&dest->z[i], _mm_sub_ps(_mm_loadu_ps(&a->z[i]), _mm_loadu_ps(&b->z[i])));
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    {
+      dest->x[i] = a->x[i] - b->x[i];
+      dest->y[i] = a->y[i] - b->y[i];
+      dest->z[i] = a->z[i] - b->z[i];
+    }
+}
+
+void
+kyu_vec_soa_mult(kyu_vec_soa *dest, float a, kyu_vec_soa *b, int count)
+{
+  int i = 0;
+
+  CHECK_SOA(dest);
+  CHECK_SOA(b);
+
+#ifdef KYU_SSE
+  {
+    __m128 s = _mm_set1_ps(a);
+
+    for (; i + 4 <= count; i += 4)
+      {
+        _mm_storeu_ps(&dest->x[i], _mm_mul_ps(s, _mm_loadu_ps(&b->x[i])));
+        _mm_storeu_ps(&dest->y[i], _mm_mul_ps(s, _mm_loadu_ps(&b->y[i])));
+        _mm_storeu_ps(&dest->z[i], _mm_mul_ps(s, _mm_loadu_ps(&b->z[i])));
+      }
+  }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    {
+      dest->x[i] = a * b->x[i];
+      dest->y[i] = a * b->y[i];
+      dest->z[i] = a * b->z[i];
+    }
+}
+
+void
+kyu_vec_soa_dot(float *dest, kyu_vec_soa *a, kyu_vec_soa *b, int count)
+{
+  int i = 0;
+
+  KYU_ASSERT(dest != NULL, "No destination array provided");
+  if (dest == NULL)
+    return;
+
+  CHECK_SOA(a);
+  CHECK_SOA(b);
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    _mm_storeu_ps(&dest[i], dot4(_mm_loadu_ps(&a->x[i]), _mm_loadu_ps(&a->y[i]),
+                                 _mm_loadu_ps(&a->z[i]), _mm_loadu_ps(&b->x[i]),
+                                 _mm_loadu_ps(&b->y[i]), _mm_loadu_ps(&b->z[i])));
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    dest[i] = (a->x[i] * b->x[i]) + (a->y[i] * b->y[i]) + (a->z[i] * b->z[i]);
+}
+
+void
+kyu_vec_soa_cross(kyu_vec_soa *dest, kyu_vec_soa *a, kyu_vec_soa *b, int count)
+{
+  int i = 0;
+  float x, y, z;
+
+  CHECK_SOA(dest);
+  CHECK_SOA(a);
+  CHECK_SOA(b);
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    {
+      __m128 ax = _mm_loadu_ps(&a->x[i]);
+      __m128 ay = _mm_loadu_ps(&a->y[i]);
+      __m128 az = _mm_loadu_ps(&a->z[i]);
+      __m128 bx = _mm_loadu_ps(&b->x[i]);
+      __m128 by = _mm_loadu_ps(&b->y[i]);
+      __m128 bz = _mm_loadu_ps(&b->z[i]);
+
+      _mm_storeu_ps(&dest->x[i], _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+      _mm_storeu_ps(&dest->y[i], _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)));
+      _mm_storeu_ps(&dest->z[i], _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)));
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    {
+      x = (a->y[i] * b->z[i]) - (a->z[i] * b->y[i]);
+      y = (a->z[i] * b->x[i]) - (a->x[i] * b->z[i]);
+      z = (a->x[i] * b->y[i]) - (a->y[i] * b->x[i]);
+
+      dest->x[i] = x;
+      dest->y[i] = y;
+      dest->z[i] = z;
+    }
+}
+
+void
+kyu_vec_soa_normalize(kyu_vec_soa *dest, kyu_vec_soa *v, int count)
+{
+  int i = 0;
+  float l;
+
+  CHECK_SOA(dest);
+  CHECK_SOA(v);
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    {
+      __m128 x = _mm_loadu_ps(&v->x[i]);
+      __m128 y = _mm_loadu_ps(&v->y[i]);
+      __m128 z = _mm_loadu_ps(&v->z[i]);
+      __m128 s = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(dot4(x, y, z, x, y, z)));
+
+      _mm_storeu_ps(&dest->x[i], _mm_mul_ps(s, x));
+      _mm_storeu_ps(&dest->y[i], _mm_mul_ps(s, y));
+      _mm_storeu_ps(&dest->z[i], _mm_mul_ps(s, z));
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    {
+      l = 1.f / sqrtf((v->x[i] * v->x[i]) + (v->y[i] * v->y[i]) + (v->z[i] * v->z[i]));
+
+      dest->x[i] = l * v->x[i];
+      dest->y[i] = l * v->y[i];
+      dest->z[i] = l * v->z[i];
+    }
+}
+
+void
+kyu_vec_soa_length(float *dest, kyu_vec_soa *v, int count)
+{
+  int i = 0;
+
+  KYU_ASSERT(dest != NULL, "No destination array provided");
+  if (dest == NULL)
+    return;
+
+  CHECK_SOA(v);
+
+#ifdef KYU_SSE
+  for (; i + 4 <= count; i += 4)
+    {
+      __m128 x = _mm_loadu_ps(&v->x[i]);
+      __m128 y = _mm_loadu_ps(&v->y[i]);
+      __m128 z = _mm_loadu_ps(&v->z[i]);
+
+      _mm_storeu_ps(&dest[i], _mm_sqrt_ps(dot4(x, y, z, x, y, z)));
+    }
+#endif /* KYU_SSE */
+
+  for (; i < count; ++i)
+    dest[i] = sqrtf((v->x[i] * v->x[i]) + (v->y[i] * v->y[i]) + (v->z[i] * v->z[i]));
+}
+
+#ifdef KYU_SSE
+static __m128
+dot4(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+                    _mm_mul_ps(az, bz));
+}
+#endif /* KYU_SSE */
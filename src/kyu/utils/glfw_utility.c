@@ -15,6 +15,8 @@
    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
 
 #include "glfw_utility.h"
+#include "kyu/core/utils.h"
+#include "kyu/core/profile.h"
 
 void resize_callback(GLFWwindow *w, int width, int height)
 {
@@ -28,4 +30,8 @@ void input_callback(GLFWwindow *w, int key, int scancode, int action, int mode)
   (void)mode;
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
     glfwSetWindowShouldClose(w, GLFW_TRUE);
+
+  if (key == GLFW_KEY_F12 && action == GLFW_PRESS
+      && kyu_profile_dump(KYU_PROFILE_FILE) == 0)
+    KYU_LOG(LOG, "Profile written to '%s'", KYU_PROFILE_FILE);
 }